@@ -23,6 +23,7 @@
 #include "filesystem/filesystem.h"
 #include "display/graphics.h"
 #include "display/font.h"
+#include "input/input.h"
 #include "system/system.h"
 
 #include "util/util.h"
@@ -31,6 +32,7 @@
 #include "util/boost-hash.h"
 #include "util/exception.h"
 #include "util/encoding.h"
+#include "util/profiler.h"
 
 #include "config.h"
 
@@ -147,6 +149,9 @@ RB_METHOD(mkxpGetAllJSONSettings);
 
 RB_METHOD(mkxpSetDefaultFontFamily);
 
+RB_METHOD(mkxpProfileStart);
+RB_METHOD(mkxpProfileStop);
+
 RB_METHOD(mriRgssMain);
 RB_METHOD(mriRgssStop);
 RB_METHOD(_kernelCaller);
@@ -259,6 +264,9 @@ static void mriBindingInit() {
     
     _rb_define_module_function(mod, "default_font_family=", mkxpSetDefaultFontFamily);
     
+    _rb_define_module_function(mod, "profile_start", mkxpProfileStart);
+    _rb_define_module_function(mod, "profile_stop", mkxpProfileStop);
+    
     _rb_define_method(rb_cString, "to_utf8", mkxpStringToUTF8);
     _rb_define_method(rb_cString, "to_utf8!", mkxpStringToUTF8Bang);
     
@@ -608,6 +616,32 @@ RB_METHOD(mkxpSetDefaultFontFamily) {
     return Qnil;
 }
 
+RB_METHOD(mkxpProfileStart) {
+    RB_UNUSED_PARAM;
+    
+    rb_check_argc(argc, 0);
+    
+    /* False when built without the profiler */
+    return rb_bool_new(Profiler::start());
+}
+
+RB_METHOD_GUARD(mkxpProfileStop) {
+    RB_UNUSED_PARAM;
+    
+    VALUE path;
+    rb_scan_args(argc, argv, "1", &path);
+    SafeStringValue(path);
+    
+    int zones = Profiler::stop(RSTRING_PTR(path));
+    
+    /* Nothing was being recorded */
+    if (zones < 0)
+        return Qnil;
+    
+    return INT2NUM(zones);
+}
+RB_METHOD_GUARD_END
+
 RB_METHOD_GUARD(mkxpStringToUTF8) {
     RB_UNUSED_PARAM;
     
@@ -1240,6 +1274,12 @@ static void mriBindingExecute() {
     
     mriBindingInit();
     
+    /* Recorded input only plays back the same
+     * with the same random numbers */
+    unsigned int seed;
+    if (shState->input().rngSeed(seed))
+        rb_funcall(rb_mKernel, rb_intern("srand"), 1, UINT2NUM(seed));
+    
     std::string &customScript = conf.customScript;
     if (!customScript.empty())
         runCustomScript(customScript);
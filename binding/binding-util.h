@@ -30,6 +30,8 @@
 #endif
 
 #include "exception.h"
+#include "sharedstate.h"
+#include "graphics.h"
 
 #ifdef RUBY_API_VERSION_MAJOR
 #define RAPI_MAJOR RUBY_API_VERSION_MAJOR
@@ -217,8 +219,13 @@ static VALUE Name##AllocatePreInit(VALUE klass) {      \
 }
 #endif
 
+/* Run by the GC, possibly while the render thread draws the object
+ * or without a current GL context, so this takes the lock like any
+ * other graphics call */
 template <class C> static void freeInstance(void *inst) {
+    GFX_LOCK;
     delete static_cast<C *>(inst);
+    GFX_UNLOCK;
 }
 
 void raiseDisposedAccess(VALUE self);
@@ -30,6 +30,13 @@
 
 #include "rb_shader.h"
 
+#if RAPI_FULL >= 310
+#include <ruby/io/buffer.h>
+#endif
+
+#include <algorithm>
+#include <string.h>
+
 #if RAPI_FULL > 187
 DEF_TYPE(Bitmap);
 #else
@@ -215,7 +222,7 @@ RB_METHOD_GUARD(bitmapGetPixel) {
     rb_get_args(argc, argv, "ii", &x, &y RB_ARG_END);
     
     Color value;
-    if (b->surface() || b->megaSurface())
+    if (b->surface())
         value = b->getPixel(x, y);
     else
         GFX_GUARD_EXC(value = b->getPixel(x, y););
@@ -419,12 +426,31 @@ RB_METHOD_GUARD(bitmapClearRect) {
 }
 RB_METHOD_GUARD_END
 
-RB_METHOD_GUARD(bitmapBlur) {
+RB_METHOD_GUARD(bitmapFlush) {
     RB_UNUSED_PARAM;
     
     Bitmap *b = getPrivateData<Bitmap>(self);
     
-    GFX_GUARD_EXC( b->blur(); );
+    GFX_GUARD_EXC( b->flush(); );
+    
+    return self;
+}
+RB_METHOD_GUARD_END
+
+RB_METHOD_GUARD(bitmapBlur) {
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    /* Without a radius, keep the original small kernel */
+    if (argc == 0) {
+        GFX_GUARD_EXC( b->blur(); );
+        
+        return Qnil;
+    }
+    
+    int radius;
+    rb_get_args(argc, argv, "i", &radius RB_ARG_END);
+    
+    GFX_GUARD_EXC( b->blur(radius); );
     
     return Qnil;
 }
@@ -442,6 +468,18 @@ RB_METHOD_GUARD(bitmapRadialBlur) {
 }
 RB_METHOD_GUARD_END
 
+RB_METHOD_GUARD(bitmapZoomBlur) {
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    int zoom, divisions;
+    rb_get_args(argc, argv, "ii", &zoom, &divisions RB_ARG_END);
+    
+    GFX_GUARD_EXC( b->zoomBlur(zoom, divisions); );
+    
+    return Qnil;
+}
+RB_METHOD_GUARD_END
+
 RB_METHOD_GUARD(bitmapGetRawData) {
     RB_UNUSED_PARAM;
     
@@ -470,6 +508,81 @@ RB_METHOD_GUARD(bitmapSetRawData) {
 }
 RB_METHOD_GUARD_END
 
+struct PixelMapping
+{
+    Bitmap *bitmap;
+    uint8_t *pixels;
+    size_t size;
+    int y, rows;
+    VALUE buffer;
+};
+
+static VALUE bitmapPixelsYield(VALUE arg) {
+    PixelMapping *m = (PixelMapping*) arg;
+    
+    return rb_yield(m->buffer);
+}
+
+static VALUE bitmapPixelsRelease(VALUE arg) {
+    PixelMapping *m = (PixelMapping*) arg;
+    
+#if RAPI_FULL >= 310
+    /* Detach the buffer so it can't outlive the mapping */
+    rb_io_buffer_free(m->buffer);
+#else
+    memcpy(m->pixels, RSTRING_PTR(m->buffer),
+           std::min(m->size, (size_t) RSTRING_LEN(m->buffer)));
+#endif
+    
+    /* Graphics.reset disposes it while unwinding */
+    if (m->bitmap->isDisposed())
+        return Qnil;
+    
+    Exception *exc = 0;
+    try {
+        GFX_GUARD_EXC(m->bitmap->unmapPixels(m->y, m->rows););
+    } catch (const Exception &e) {
+        exc = new Exception(e);
+    }
+    if (exc)
+        raiseRbExc(exc);
+    
+    return Qnil;
+}
+
+RB_METHOD_GUARD(bitmapWithPixels) {
+    rb_need_block();
+    
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    int y = 0, rows = -1;
+    rb_get_args(argc, argv, "|ii", &y, &rows RB_ARG_END);
+    
+    PixelMapping m;
+    m.bitmap = b;
+    
+    GFX_GUARD_EXC(m.pixels = (uint8_t*) b->mapPixels(););
+    
+    int stride = b->width() * 4;
+    
+    m.y = clamp(y, 0, b->height());
+    m.rows = clamp((rows < 0) ? b->height() : rows, 0, b->height() - m.y);
+    m.pixels += m.y * stride;
+    m.size = m.rows * stride;
+    
+    /* Only the requested rows are exposed, and only
+     * those are uploaded again afterwards */
+#if RAPI_FULL >= 310
+    m.buffer = rb_io_buffer_new(m.pixels, m.size, RB_IO_BUFFER_EXTERNAL);
+#else
+    m.buffer = rb_str_new((const char*) m.pixels, m.size);
+#endif
+    
+    return rb_ensure(RUBY_METHOD_FUNC(bitmapPixelsYield), (VALUE) &m,
+                     RUBY_METHOD_FUNC(bitmapPixelsRelease), (VALUE) &m);
+}
+RB_METHOD_GUARD_END
+
 RB_METHOD_GUARD(bitmapSaveToFile) {
     RB_UNUSED_PARAM;
     
@@ -485,6 +598,22 @@ RB_METHOD_GUARD(bitmapSaveToFile) {
 }
 RB_METHOD_GUARD_END
 
+RB_METHOD_GUARD(bitmapSaveToFileAsync) {
+    RB_UNUSED_PARAM;
+    
+    VALUE str;
+    rb_scan_args(argc, argv, "1", &str);
+    SafeStringValue(str);
+    
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    int ticket;
+    GFX_GUARD_EXC(ticket = b->saveToFileAsync(RSTRING_PTR(str)););
+    
+    return INT2NUM(ticket);
+}
+RB_METHOD_GUARD_END
+
 RB_METHOD_GUARD(bitmapGetMega){
     RB_UNUSED_PARAM;
     
@@ -848,12 +977,16 @@ void bitmapBindingInit() {
     
     _rb_define_method(klass, "raw_data", bitmapGetRawData);
     _rb_define_method(klass, "raw_data=", bitmapSetRawData);
+    _rb_define_method(klass, "with_pixels", bitmapWithPixels);
     _rb_define_method(klass, "to_file", bitmapSaveToFile);
+    _rb_define_method(klass, "to_file_async", bitmapSaveToFileAsync);
     
     _rb_define_method(klass, "gradient_fill_rect", bitmapGradientFillRect);
     _rb_define_method(klass, "clear_rect", bitmapClearRect);
+    _rb_define_method(klass, "flush", bitmapFlush);
     _rb_define_method(klass, "blur", bitmapBlur);
     _rb_define_method(klass, "radial_blur", bitmapRadialBlur);
+    _rb_define_method(klass, "zoom_blur", bitmapZoomBlur);
     
     _rb_define_method(klass, "mega?", bitmapGetMega);
     rb_define_singleton_method(klass, "max_size", RUBY_METHOD_FUNC(bitmapGetMaxSize), -1);
@@ -16,6 +16,20 @@ RB_METHOD(comiledShaderInitialize)
     if (!aryArgs)
         aryArgs = rb_ary_new();
 
+    /* Frozen copies of the names serve as hash keys when
+     * applying arguments, sparing a string per lookup */
+    long argCount = rb_array_len(aryArgs);
+    VALUE keys = rb_ary_new();
+
+    for (long i = 0; i < argCount; ++i)
+    {
+        VALUE name = rb_ary_entry(aryArgs, i);
+        StringValue(name);
+        rb_ary_push(keys, rb_str_new_frozen(name));
+    }
+
+    aryArgs = keys;
+
     CompiledShader *shader;
     if (vertContents)
     {
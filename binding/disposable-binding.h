@@ -121,7 +121,7 @@ disposableDisposeChildren(VALUE disp)
 }
 
 template<class C>
-RB_METHOD(disposableDispose)
+RB_METHOD_GUARD(disposableDispose)
 {
 	RB_UNUSED_PARAM;
 	
@@ -137,12 +137,11 @@ RB_METHOD(disposableDispose)
 	if (rgssVer == 1)
 		disposableDisposeChildren(self);
 
-    GFX_LOCK;
-	d->dispose();
-    GFX_UNLOCK;
+    GFX_GUARD_EXC( d->dispose(); );
 
 	return Qnil;
 }
+RB_METHOD_GUARD_END
 
 template<class C>
 RB_METHOD(disposableIsDisposed)
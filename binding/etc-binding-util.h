@@ -11,7 +11,9 @@
     Klass *p = getPrivateData<Klass>(self);                                    \
     arg_type arg;                                                              \
     rb_get_args(argc, argv, arg_t_s, &arg RB_ARG_END);                         \
+    GFX_LOCK;                                                                  \
     p->set##Attr(arg);                                                         \
+    GFX_UNLOCK;                                                                \
     return *argv;                                                              \
   }
 
@@ -37,13 +39,17 @@
 		{ \
 			VALUE otherObj = argv[0]; \
 			Klass *other = getPrivateDataCheck<Klass>(otherObj, Klass##Type); \
+			GFX_LOCK; \
 			*k = *other; \
+			GFX_UNLOCK; \
 		} \
 		else \
 		{ \
 			param_type p1, p2, p3, p4 = last_param_def; \
 			rb_get_args(argc, argv, param_t_s, &p1, &p2, &p3, &p4 RB_ARG_END); \
+			GFX_LOCK; \
 			k->set(p1, p2, p3, p4); \
+			GFX_UNLOCK; \
 		} \
 		return self; \
 	}
@@ -56,13 +62,17 @@
 		{ \
 			VALUE otherObj = argv[0]; \
 			Klass *other = getPrivateDataCheck<Klass>(otherObj, Klass##Type); \
+			GFX_LOCK; \
 			*k = *other; \
+			GFX_UNLOCK; \
 		} \
 		else \
 		{ \
 			param_type p1, p2 = last_param_def; \
 			rb_get_args(argc, argv, param_t_s, &p1, &p2 RB_ARG_END); \
+			GFX_LOCK; \
 			k->set(p1, p2); \
+			GFX_UNLOCK; \
 		} \
 		return self; \
 	}
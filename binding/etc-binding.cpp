@@ -66,7 +66,9 @@ EQUAL_FUN(Rect)
     }                                                                          \
     Klass *orig = getPrivateDataNoRaise<Klass>(self);                          \
     if (orig) {                                                                \
+      GFX_LOCK;                                                                \
       *orig = *k;                                                              \
+      GFX_UNLOCK;                                                              \
       delete k;                                                                \
     } else {                                                                   \
     setPrivateData(self, k);                                                   \
@@ -85,7 +87,9 @@ SET_FUN(Rect, int, "iiii", 0)
 RB_METHOD(rectEmpty) {
   RB_UNUSED_PARAM;
   Rect *r = getPrivateData<Rect>(self);
+  GFX_LOCK;
   r->empty();
+  GFX_UNLOCK;
   return self;
 }
 
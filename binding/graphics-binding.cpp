@@ -24,6 +24,11 @@
 #include "binding-util.h"
 #include "binding-types.h"
 #include "exception.h"
+#include "imagesaver.h"
+#include "texpool.h"
+#include "spriteatlas.h"
+#include "scene.h"
+#include "shader.h"
 
 RB_METHOD(graphicsDelta) {
     RB_UNUSED_PARAM;
@@ -36,6 +41,10 @@ RB_METHOD(graphicsDelta) {
 RB_METHOD_GUARD(graphicsUpdate)
 {
     RB_UNUSED_PARAM;
+    
+    /* Still holding the GVL here */
+    GFX_GUARD_EXC( shState->graphics().checkCustomShaders(); );
+    
 #if RAPI_MAJOR >= 2
     drop_gvl_guard([](void*) -> void* {
         GFX_GUARD_EXC( shState->graphics().update(); );
@@ -205,6 +214,7 @@ RB_METHOD_GUARD(graphicsWait)
     
     int duration;
     rb_get_args(argc, argv, "i", &duration RB_ARG_END);
+    GFX_GUARD_EXC( shState->graphics().checkCustomShaders(); );
 #if RAPI_MAJOR >= 2
     drop_gvl_guard([](void* d) -> void* {
         GFX_GUARD_EXC( shState->graphics().wait(*(int*)d); );
@@ -223,6 +233,7 @@ RB_METHOD_GUARD(graphicsFadeout)
     
     int duration;
     rb_get_args(argc, argv, "i", &duration RB_ARG_END);
+    GFX_GUARD_EXC( shState->graphics().checkCustomShaders(); );
     
 #if RAPI_MAJOR >= 2
     drop_gvl_guard([](void* d) -> void* {
@@ -243,6 +254,7 @@ RB_METHOD_GUARD(graphicsFadein)
     
     int duration;
     rb_get_args(argc, argv, "i", &duration RB_ARG_END);
+    GFX_GUARD_EXC( shState->graphics().checkCustomShaders(); );
     
 #if RAPI_MAJOR >= 2
     drop_gvl_guard([](void* d) -> void* {
@@ -274,6 +286,54 @@ RB_METHOD_GUARD(graphicsSnapToBitmap)
 }
 RB_METHOD_GUARD_END
 
+RB_METHOD_GUARD(graphicsCaptureAsync)
+{
+    RB_UNUSED_PARAM;
+    
+    int handle;
+    GFX_GUARD_EXC( handle = shState->graphics().captureAsync(); );
+    
+    return INT2NUM(handle);
+}
+RB_METHOD_GUARD_END
+
+RB_METHOD(graphicsCaptureReady)
+{
+    RB_UNUSED_PARAM;
+    
+    int handle;
+    rb_get_args(argc, argv, "i", &handle RB_ARG_END);
+    
+    GFX_LOCK;
+    bool ready = shState->graphics().captureReady(handle);
+    GFX_UNLOCK;
+    
+    return rb_bool_new(ready);
+}
+
+/* Returns nil while the capture is pending, and
+ * for handles that were fetched or dropped */
+RB_METHOD_GUARD(graphicsCaptureResult)
+{
+    RB_UNUSED_PARAM;
+    
+    int handle;
+    rb_get_args(argc, argv, "i", &handle RB_ARG_END);
+    
+    Bitmap *result = 0;
+    
+    GFX_GUARD_EXC( result = shState->graphics().captureResult(handle); );
+    
+    if (!result)
+        return Qnil;
+    
+    VALUE obj = wrapObject(result, BitmapType);
+    bitmapInitProps(result, obj);
+    
+    return obj;
+}
+RB_METHOD_GUARD_END
+
 RB_METHOD(graphicsResizeScreen)
 {
     RB_UNUSED_PARAM;
@@ -395,6 +455,266 @@ RB_METHOD_GUARD(graphicsScreenshot)
 }
 RB_METHOD_GUARD_END
 
+RB_METHOD_GUARD(graphicsScreenshotAsync)
+{
+    RB_UNUSED_PARAM;
+    
+    VALUE filename;
+    rb_scan_args(argc, argv, "1", &filename);
+    SafeStringValue(filename);
+    
+    int ticket;
+    GFX_GUARD_EXC(ticket = shState->graphics().screenshotAsync(RSTRING_PTR(filename)););
+    
+    return INT2NUM(ticket);
+}
+RB_METHOD_GUARD_END
+
+/* Returns :pending or :done for a ticket handed out by
+ * Bitmap#to_file_async or Graphics.screenshot_async, raises
+ * if the save failed, and returns nil for unknown tickets */
+RB_METHOD_GUARD(graphicsSaveStatus)
+{
+    RB_UNUSED_PARAM;
+    
+    int ticket;
+    rb_get_args(argc, argv, "i", &ticket RB_ARG_END);
+    
+    ImageSaver::Status status;
+    std::string error;
+    
+    GFX_LOCK;
+    shState->imageSaver().poll();
+    status = shState->imageSaver().status(ticket, &error);
+    GFX_UNLOCK;
+    
+    switch (status)
+    {
+    case ImageSaver::Pending :
+        return ID2SYM(rb_intern("pending"));
+    case ImageSaver::Done :
+        return ID2SYM(rb_intern("done"));
+    case ImageSaver::Failed :
+        throw Exception(Exception::SDLError, "%s", error.c_str());
+    default :
+        return Qnil;
+    }
+}
+RB_METHOD_GUARD_END
+
+/* Options: format: :y4m (default) or :raw */
+RB_METHOD_GUARD(graphicsStartRecording)
+{
+    RB_UNUSED_PARAM;
+    
+    VALUE path, options;
+    rb_scan_args(argc, argv, "11", &path, &options);
+    SafeStringValue(path);
+    
+    bool raw = false;
+    
+    if (!NIL_P(options))
+    {
+        Check_Type(options, T_HASH);
+        VALUE format = rb_hash_aref(options, ID2SYM(rb_intern("format")));
+        
+        if (format == ID2SYM(rb_intern("raw")))
+            raw = true;
+        else if (!NIL_P(format) && format != ID2SYM(rb_intern("y4m")))
+            throw Exception(Exception::ArgumentError, "Unknown recording format (expected :y4m or :raw)");
+    }
+    
+    GFX_GUARD_EXC(shState->graphics().startRecording(RSTRING_PTR(path), raw););
+    
+    return Qnil;
+}
+RB_METHOD_GUARD_END
+
+/* Returns the number of frames written and dropped,
+ * or nil if nothing was being recorded */
+RB_METHOD_GUARD(graphicsStopRecording)
+{
+    RB_UNUSED_PARAM;
+    
+    int written = 0, dropped = 0;
+    bool stopped = false;
+    
+    GFX_GUARD_EXC(stopped = shState->graphics().stopRecording(written, dropped););
+    
+    if (!stopped)
+        return Qnil;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")), INT2NUM(written));
+    rb_hash_aset(hash, ID2SYM(rb_intern("dropped")), INT2NUM(dropped));
+    
+    return hash;
+}
+RB_METHOD_GUARD_END
+
+RB_METHOD(graphicsIsRecording)
+{
+    RB_UNUSED_PARAM;
+    
+    return rb_bool_new(shState->graphics().isRecording());
+}
+
+RB_METHOD(graphicsTexturePoolStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    TexPool::Stats stats = shState->texPool().stats();
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+    rb_hash_aset(hash, ID2SYM(rb_intern("resized")), ULL2NUM(stats.resized));
+    rb_hash_aset(hash, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+    rb_hash_aset(hash, ID2SYM(rb_intern("evictions")), ULL2NUM(stats.evictions));
+    rb_hash_aset(hash, ID2SYM(rb_intern("bytes")), SIZET2NUM(stats.bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("count")), SIZET2NUM(stats.count));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsSpriteAtlasStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    std::vector<SpriteAtlas::PageStats> pages = shState->spriteAtlas().stats();
+    GFX_UNLOCK;
+    
+    VALUE ary = rb_ary_new();
+    
+    for (size_t i = 0; i < pages.size(); ++i)
+    {
+        VALUE hash = rb_hash_new();
+        
+        rb_hash_aset(hash, ID2SYM(rb_intern("width")), INT2NUM(pages[i].width));
+        rb_hash_aset(hash, ID2SYM(rb_intern("height")), INT2NUM(pages[i].height));
+        rb_hash_aset(hash, ID2SYM(rb_intern("entries")), INT2NUM(pages[i].entries));
+        rb_hash_aset(hash, ID2SYM(rb_intern("used_area")), SIZET2NUM(pages[i].usedArea));
+        rb_hash_aset(hash, ID2SYM(rb_intern("shelf_area")), SIZET2NUM(pages[i].shelfArea));
+        
+        rb_ary_push(ary, hash);
+    }
+    
+    return ary;
+}
+
+RB_METHOD(graphicsCullStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    Scene::CullStats stats = Scene::cullStats;
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("drawn")), INT2NUM(stats.drawn));
+    rb_hash_aset(hash, ID2SYM(rb_intern("culled")), INT2NUM(stats.culled));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsUniformStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    Shader::UniformStats stats = Shader::uniformStats;
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("issued")), ULL2NUM(stats.issued));
+    rb_hash_aset(hash, ID2SYM(rb_intern("skipped")), ULL2NUM(stats.skipped));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsFramePacingStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    Graphics::PacingStats stats = shState->graphics().pacingStats();
+    GFX_UNLOCK;
+    
+    VALUE histogram = rb_ary_new();
+    
+    for (int i = 0; i < Graphics::PacingStats::Buckets; ++i)
+    {
+        VALUE bucket = rb_hash_new();
+        VALUE limit = (i < Graphics::PacingStats::Buckets - 1)
+            ? INT2NUM(Graphics::PacingStats::bucketLimitsUs[i]) : Qnil;
+        
+        rb_hash_aset(bucket, ID2SYM(rb_intern("below_us")), limit);
+        rb_hash_aset(bucket, ID2SYM(rb_intern("count")), ULL2NUM(stats.histogram[i]));
+        
+        rb_ary_push(histogram, bucket);
+    }
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")), ULL2NUM(stats.frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("missed")), ULL2NUM(stats.missed));
+    rb_hash_aset(hash, ID2SYM(rb_intern("overslept")), ULL2NUM(stats.overslept));
+    rb_hash_aset(hash, ID2SYM(rb_intern("histogram")), histogram);
+    
+    return hash;
+}
+
+RB_METHOD(graphicsFrameStats)
+{
+    RB_UNUSED_PARAM;
+    
+    int window = 120;
+    rb_get_args(argc, argv, "|i", &window RB_ARG_END);
+    
+    /* Lock-free; doesn't wait for a frame in flight */
+    Graphics::FrameStats stats = shState->graphics().frameStats(window);
+    
+    static const char *phaseNames[] =
+    {
+        "script", "composite", "present", "sleep", "interval"
+    };
+    
+    VALUE hash = rb_hash_new();
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")), INT2NUM(stats.frames));
+    
+    for (int i = 0; i < Graphics::FrameStats::PhaseCount; ++i)
+    {
+        const Graphics::FrameStats::Summary &sum = stats.phases[i];
+        VALUE phase = rb_hash_new();
+        
+        rb_hash_aset(phase, ID2SYM(rb_intern("p50")), rb_float_new(sum.p50));
+        rb_hash_aset(phase, ID2SYM(rb_intern("p90")), rb_float_new(sum.p90));
+        rb_hash_aset(phase, ID2SYM(rb_intern("p99")), rb_float_new(sum.p99));
+        rb_hash_aset(phase, ID2SYM(rb_intern("max")), rb_float_new(sum.max));
+        
+        rb_hash_aset(hash, ID2SYM(rb_intern(phaseNames[i])), phase);
+    }
+    
+    return hash;
+}
+
+RB_METHOD(graphicsWarmShaders)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    shState->shaders().warm();
+    GFX_UNLOCK;
+    
+    return Qnil;
+}
+
 DEF_GRA_PROP_I(FrameRate)
 DEF_GRA_PROP_I(FrameCount)
 DEF_GRA_PROP_I(Brightness)
@@ -425,6 +745,18 @@ void graphicsBindingInit()
     _rb_define_module_function(module, "transition", graphicsTransition);
     _rb_define_module_function(module, "frame_reset", graphicsFrameReset);
     _rb_define_module_function(module, "screenshot", graphicsScreenshot);
+    _rb_define_module_function(module, "screenshot_async", graphicsScreenshotAsync);
+    _rb_define_module_function(module, "start_recording", graphicsStartRecording);
+    _rb_define_module_function(module, "stop_recording", graphicsStopRecording);
+    _rb_define_module_function(module, "recording?", graphicsIsRecording);
+    _rb_define_module_function(module, "save_status", graphicsSaveStatus);
+    _rb_define_module_function(module, "texture_pool_stats", graphicsTexturePoolStats);
+    _rb_define_module_function(module, "sprite_atlas_stats", graphicsSpriteAtlasStats);
+    _rb_define_module_function(module, "cull_stats", graphicsCullStats);
+    _rb_define_module_function(module, "uniform_stats", graphicsUniformStats);
+    _rb_define_module_function(module, "warm_shaders", graphicsWarmShaders);
+    _rb_define_module_function(module, "frame_pacing_stats", graphicsFramePacingStats);
+    _rb_define_module_function(module, "frame_stats", graphicsFrameStats);
     
     _rb_define_module_function(module, "__reset__", graphicsReset);
     
@@ -440,6 +772,9 @@ void graphicsBindingInit()
     _rb_define_module_function(module, "fadeout", graphicsFadeout);
     _rb_define_module_function(module, "fadein", graphicsFadein);
     _rb_define_module_function(module, "snap_to_bitmap", graphicsSnapToBitmap);
+    _rb_define_module_function(module, "capture_async", graphicsCaptureAsync);
+    _rb_define_module_function(module, "capture_ready?", graphicsCaptureReady);
+    _rb_define_module_function(module, "capture_result", graphicsCaptureResult);
     _rb_define_module_function(module, "resize_screen", graphicsResizeScreen);
     _rb_define_module_function(module, "resize_window", graphicsResizeWindow);
     _rb_define_module_function(module, "center", graphicsCenter);
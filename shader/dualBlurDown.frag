@@ -0,0 +1,21 @@
+/* Dual filter blur, downsampling pass */
+
+uniform sampler2D texture;
+uniform vec2 texSizeInv;
+uniform float offset;
+
+varying vec2 v_texCoord;
+
+void main()
+{
+	vec2 hp = texSizeInv * 0.5 * offset;
+
+	lowp vec4 frag = texture2D(texture, v_texCoord) * 4.0;
+
+	frag += texture2D(texture, v_texCoord - hp);
+	frag += texture2D(texture, v_texCoord + hp);
+	frag += texture2D(texture, v_texCoord + vec2(hp.x, -hp.y));
+	frag += texture2D(texture, v_texCoord - vec2(hp.x, -hp.y));
+
+	gl_FragColor = frag / 8.0;
+}
@@ -0,0 +1,24 @@
+/* Dual filter blur, upsampling pass */
+
+uniform sampler2D texture;
+uniform vec2 texSizeInv;
+uniform float offset;
+
+varying vec2 v_texCoord;
+
+void main()
+{
+	vec2 hp = texSizeInv * 0.5 * offset;
+
+	lowp vec4 frag = texture2D(texture, v_texCoord + vec2(-hp.x * 2.0, 0.0));
+
+	frag += texture2D(texture, v_texCoord + vec2(-hp.x, hp.y)) * 2.0;
+	frag += texture2D(texture, v_texCoord + vec2(0.0, hp.y * 2.0));
+	frag += texture2D(texture, v_texCoord + vec2(hp.x, hp.y)) * 2.0;
+	frag += texture2D(texture, v_texCoord + vec2(hp.x * 2.0, 0.0));
+	frag += texture2D(texture, v_texCoord + vec2(hp.x, -hp.y)) * 2.0;
+	frag += texture2D(texture, v_texCoord + vec2(0.0, -hp.y * 2.0));
+	frag += texture2D(texture, v_texCoord + vec2(-hp.x, -hp.y)) * 2.0;
+
+	gl_FragColor = frag / 12.0;
+}
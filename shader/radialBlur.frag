@@ -0,0 +1,57 @@
+/* Radial and zoom blur in a single pass: every pixel averages
+ * samples rotated and/or scaled around the bitmap center.
+ * Samples falling off the edges are mirrored back in once,
+ * matching the old multi-draw implementation */
+
+uniform sampler2D texture;
+uniform vec2 texSizeInv;
+
+uniform int samples;
+uniform float baseAngle;
+uniform float angleStep;
+uniform float zoomStep;
+
+varying vec2 v_texCoord;
+
+/* Must match the clamp in Bitmap */
+#define MAX_SAMPLES 100
+
+void main()
+{
+	vec2 size = 1.0 / texSizeInv;
+	vec2 center = size * 0.5;
+	vec2 dist = v_texCoord * size - center;
+
+	vec4 sum = vec4(0.0);
+
+	for (int i = 0; i < MAX_SAMPLES; ++i)
+	{
+		if (i >= samples)
+			break;
+
+		float angle = baseAngle + float(i) * angleStep;
+		float c = cos(angle);
+		float s = sin(angle);
+
+		vec2 pos = vec2(c * dist.x + s * dist.y, c * dist.y - s * dist.x);
+		pos = pos / (1.0 + float(i) * zoomStep) + center;
+
+		/* Only one mirrored copy exists per side, and
+		 * none across the corners */
+		float mirrored = 0.0;
+
+		if (pos.x < 0.0) { pos.x = -pos.x; mirrored += 1.0; }
+		else if (pos.x > size.x) { pos.x = 2.0 * size.x - pos.x; mirrored += 1.0; }
+
+		if (pos.y < 0.0) { pos.y = -pos.y; mirrored += 1.0; }
+		else if (pos.y > size.y) { pos.y = 2.0 * size.y - pos.y; mirrored += 1.0; }
+
+		if (mirrored > 1.0 || pos.x < 0.0 || pos.y < 0.0 || pos.x > size.x || pos.y > size.y)
+			continue;
+
+		lowp vec4 frag = texture2D(texture, pos * texSizeInv);
+		sum += vec4(frag.rgb * frag.a, frag.a);
+	}
+
+	gl_FragColor = sum / float(samples);
+}
@@ -2,6 +2,7 @@
 uniform mat4 projMat;
 
 uniform vec2 texSizeInv;
+uniform vec2 frameOffset;
 uniform vec2 translation;
 
 attribute vec2 position;
@@ -13,5 +14,5 @@ void main()
 {
 	gl_Position = projMat * vec4(position + translation, 0, 1);
 
-	v_texCoord = texCoord * texSizeInv;
+	v_texCoord = (texCoord + frameOffset) * texSizeInv;
 }
@@ -3,6 +3,7 @@ uniform mat4 projMat;
 uniform mat4 matrix;
 
 uniform vec2 texSizeInv;
+uniform vec2 frameOffset;
 
 attribute vec2 position;
 attribute vec2 texCoord;
@@ -15,6 +16,6 @@ void main()
 {
 	gl_Position = projMat * matrix * vec4(position, 0, 1);
 
-	v_texCoord = texCoord * texSizeInv;
+	v_texCoord = (texCoord + frameOffset) * texSizeInv;
 	v_color = color;
 }
@@ -0,0 +1,26 @@
+
+uniform mat4 projMat;
+
+uniform vec2 texSizeInv;
+
+attribute vec2 position;
+attribute vec2 texCoord;
+attribute vec4 color;
+attribute vec4 tone;
+attribute float opacity;
+
+varying vec2 v_texCoord;
+varying vec4 v_color;
+varying vec4 v_tone;
+varying float v_opacity;
+
+void main()
+{
+	/* Positions arrive already transformed */
+	gl_Position = projMat * vec4(position, 0, 1);
+
+	v_texCoord = texCoord * texSizeInv;
+	v_color = color;
+	v_tone = tone;
+	v_opacity = opacity;
+}
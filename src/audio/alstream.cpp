@@ -28,6 +28,7 @@
 #include "aldatasource.h"
 #include "sdl-util.h"
 #include "debugwriter.h"
+#include "profiler.h"
 
 #include <SDL_mutex.h>
 #include <SDL_thread.h>
@@ -349,6 +350,8 @@ void ALStream::checkStopped()
 /* thread func */
 void ALStream::streamData()
 {
+	PROFILE_THREAD("Audio stream");
+
 	/* Fill up queue */
 	bool firstBuffer = true;
 	ALDataSource::Status status;
@@ -366,7 +369,10 @@ void ALStream::streamData()
 
 		AL::Buffer::ID buf = alBuf[i];
 
-		status = source->fillBuffer(buf);
+		{
+			PROFILE_ZONE("ALStream::fillBuffer");
+			status = source->fillBuffer(buf);
+		}
 
 		if (status == ALDataSource::Error)
 			return;
@@ -432,7 +438,10 @@ void ALStream::streamData()
 			if (sourceExhausted)
 				continue;
 
-			status = source->fillBuffer(buf);
+			{
+				PROFILE_ZONE("ALStream::fillBuffer");
+				status = source->fillBuffer(buf);
+			}
 
 			if (status == ALDataSource::Error)
 			{
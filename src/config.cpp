@@ -152,6 +152,12 @@ void Config::read(int argc, char *argv[]) {
         {"fixedFramerate", 0},
         {"frameSkip", false},
         {"syncToRefreshrate", false},
+        {"renderThread", false},
+        {"headless", false},
+        {"headlessFrameDump", ""},
+        {"headlessFrameDumpInterval", 1},
+        {"inputRecord", ""},
+        {"inputReplay", ""},
         {"solidFonts", json::array({})},
 #if defined(__APPLE__) && defined(__aarch64__)
         {"angleRenderer", "metal"},
@@ -165,6 +171,10 @@ void Config::read(int argc, char *argv[]) {
         {"integerScalingActive", false},
         {"integerScalingLastMile", true},
         {"maxTextureSize", 0},
+        {"texPoolBudget", 20},
+        {"texPoolSizeClasses", "none"},
+        {"spriteAtlas", true},
+        {"shaderCache", true},
         {"gameFolder", ""},
         {"anyAltToggleFS", false},
         {"enableReset", true},
@@ -214,6 +224,8 @@ try { exp } catch (...) {}
     editor.debug = false;
     editor.battleTest = false;
     
+    bool headlessArg = false;
+    
     if (argc > 1) {
         if (!strcmp(argv[1], "debug") || !strcmp(argv[1], "test"))
             editor.debug = true;
@@ -221,7 +233,9 @@ try { exp } catch (...) {}
             editor.battleTest = true;
         
         for (int i = 1; i < argc; i++) {
-            if (strcmp(argv[i], "debug"))
+            if (!strcmp(argv[i], "--headless"))
+                headlessArg = true;
+            else if (strcmp(argv[i], "debug"))
                 launchArgs.push_back(argv[i]);
         }
     }
@@ -276,6 +290,12 @@ try { exp } catch (...) {}
     SET_OPT(fixedFramerate, integer);
     SET_OPT(frameSkip, boolean);
     SET_OPT(syncToRefreshrate, boolean);
+    SET_OPT(renderThread, boolean);
+    SET_OPT_CUSTOMKEY(headless.enabled, headless, boolean);
+    SET_STRINGOPT(headless.frameDump, headlessFrameDump);
+    SET_OPT_CUSTOMKEY(headless.frameDumpInterval, headlessFrameDumpInterval, integer);
+    SET_STRINGOPT(inputRecord, inputRecord);
+    SET_STRINGOPT(inputReplay, inputReplay);
     fillStringVec(opts["solidFonts"], solidFonts);
     SET_STRINGOPT(angleRenderer, angleRenderer);
     SET_OPT(subImageFix, boolean);
@@ -283,6 +303,10 @@ try { exp } catch (...) {}
     SET_OPT_CUSTOMKEY(integerScaling.active, integerScalingActive, boolean);
     SET_OPT_CUSTOMKEY(integerScaling.lastMileScaling, integerScalingLastMile, boolean);
     SET_OPT(maxTextureSize, integer);
+    SET_OPT_CUSTOMKEY(texPool.budget, texPoolBudget, integer);
+    SET_STRINGOPT(texPool.sizeClasses, texPoolSizeClasses);
+    SET_OPT(spriteAtlas, boolean);
+    SET_OPT(shaderCache, boolean);
     SET_OPT(anyAltToggleFS, boolean);
     SET_OPT(enableReset, boolean);
     SET_OPT(volumeScale, integer);
@@ -314,6 +338,25 @@ try { exp } catch (...) {}
     BINDING_NAME(l);
     BINDING_NAME(r);
     
+    /* Nothing to present to, so draw as fast as possible */
+    headless.enabled = headless.enabled || headlessArg;
+    if (headless.frameDumpInterval < 1)
+        headless.frameDumpInterval = 1;
+    
+    /* A negative fixedFramerate also turns the limiter off */
+    uncappedFramerate = fixedFramerate < 0;
+    if (fixedFramerate < 0)
+        fixedFramerate = 0;
+    
+    if (headless.enabled) {
+        vsync = false;
+        syncToRefreshrate = false;
+        uncappedFramerate = true;
+        frameSkip = false;
+        renderThread = false;
+        fullscreen = false;
+    }
+    
     rgssVersion = clamp(rgssVersion, 0, 3);
     SE.sourceCount = clamp(SE.sourceCount, 1, 64);
     BGM.trackCount = clamp(BGM.trackCount, 1, 16);
@@ -51,8 +51,23 @@ struct Config {
     std::string windowTitle;
     
     int fixedFramerate;
+    
+    /* Not read from the config; set for headless mode
+     * (or a negative fixedFramerate) */
+    bool uncappedFramerate;
+    
     bool frameSkip;
     bool syncToRefreshrate;
+    bool renderThread;
+    
+    struct {
+        bool enabled;
+        std::string frameDump;
+        int frameDumpInterval;
+    } headless;
+    
+    std::string inputRecord;
+    std::string inputReplay;
     
     std::vector<std::string> solidFonts;
     
@@ -60,6 +75,15 @@ struct Config {
     bool enableBlitting;
     int maxTextureSize;
     
+    struct {
+        int budget;
+        std::string sizeClasses;
+    } texPool;
+    
+    bool spriteAtlas;
+    
+    bool shaderCache;
+    
     struct {
         bool active;
         bool lastMileScaling;
@@ -33,12 +33,13 @@
 #include "gl-meta.h"
 #include "quad.h"
 #include "quadarray.h"
-#include "transform.h"
 #include "exception.h"
 
 #include "sharedstate.h"
 #include "glstate.h"
 #include "texpool.h"
+#include "spriteatlas.h"
+#include "imagesaver.h"
 #include "shader.h"
 #include "filesystem.h"
 #include "font.h"
@@ -56,13 +57,17 @@
 #include <math.h>
 #include <algorithm>
 
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
 extern "C" {
 #include "libnsgif/libnsgif.h"
 }
 
 #define GUARD_MEGA \
 { \
-if (p->megaSurface) \
+if (p->isMega()) \
 throw Exception(Exception::MKXPError, \
 "Operation not supported for mega surfaces"); \
 }
@@ -81,8 +86,18 @@ throw Exception(Exception::MKXPError, \
 "Operation not supported for static bitmaps"); \
 }
 
+#define GUARD_MAPPED \
+{ \
+if (p->mappedPixels > 0) \
+throw Exception(Exception::MKXPError, \
+"Operation not supported while the pixels are mapped"); \
+}
+
 #define OUTLINE_SIZE 1
 
+/* Enough for a radius of 512 */
+#define BLUR_MAX_LEVELS 8
+
 /* Normalize (= ensure width and
  * height are positive) */
 static IntRect normalizedRect(const IntRect &rect)
@@ -153,6 +168,256 @@ static void gif_bitmap_modified(void *bitmap)
 
 // --------------------
 
+/* Storage for the frames of an animated bitmap. Instead of giving
+ * every frame its own texture, frames are packed as cells of a grid
+ * into as few textures ("pages") as the max texture size permits,
+ * so drawing any frame binds the same texture and only the shader's
+ * frame offset uniform changes. Frames refer to their cell through
+ * an indirection, so inserting or removing frames never moves pixels */
+struct FrameStrip
+{
+    int width;
+    int height;
+    
+    /* Grid layout of a full page */
+    int cols;
+    int cellsPerPage;
+    
+    std::vector<TEXFBO> pages;
+    
+    /* Cell of each frame, in playback order */
+    std::vector<int> cells;
+    
+    /* Cells vacated by removed frames */
+    std::vector<int> freeCells;
+    
+    /* Cells handed out / backed by pages so far */
+    int usedCells;
+    int capacity;
+    
+    FrameStrip()
+    : width(0), height(0),
+    cols(1), cellsPerPage(1),
+    usedCells(0), capacity(0)
+    {}
+    
+    void setup(int w, int h)
+    {
+        clear();
+        
+        width = w;
+        height = h;
+        
+        int maxSize = glState.caps.maxTexSize;
+        cols = std::max(1, maxSize / w);
+        cellsPerPage = cols * std::max(1, maxSize / h);
+    }
+    
+    size_t size() const
+    {
+        return cells.size();
+    }
+    
+    TEXFBO &page(int cell)
+    {
+        return pages[cell / cellsPerPage];
+    }
+    
+    IntRect cellRect(int cell) const
+    {
+        int local = cell % cellsPerPage;
+        
+        return IntRect((local % cols) * width, (local / cols) * height,
+                       width, height);
+    }
+    
+    /* Makes room for at least 'count' cells in total. The last page
+     * grows geometrically until it is full, then a new one is begun */
+    void reserve(int count)
+    {
+        while (capacity < count)
+        {
+            int pageCap = capacity - ((int)pages.size() - 1) * cellsPerPage;
+            
+            if (pages.empty() || pageCap == cellsPerPage)
+            {
+                int cap = std::min(cellsPerPage, count - capacity);
+                pages.push_back(allocPage(cap));
+                capacity += cap;
+                
+                continue;
+            }
+            
+            int cap = std::min(cellsPerPage,
+                               std::max(pageCap * 2, pageCap + count - capacity));
+            
+            TEXFBO grown = allocPage(cap);
+            TEXFBO &old = pages.back();
+            
+            /* The grid layout doesn't depend on the page size,
+             * so existing cells can be carried over in one go */
+            GLMeta::blitBegin(grown);
+            GLMeta::blitSource(old);
+            GLMeta::blitRectangle(IntRect(0, 0, old.width, old.height), Vec2i());
+            GLMeta::blitEnd();
+            
+            shState->texPool().release(old);
+            old = grown;
+            capacity += cap - pageCap;
+        }
+    }
+    
+    /* Adds a frame at 'position' (appended if out of range)
+     * and returns the cell its contents have to be put into */
+    int insert(int position)
+    {
+        int cell;
+        
+        if (!freeCells.empty())
+        {
+            cell = freeCells.back();
+            freeCells.pop_back();
+        }
+        else
+        {
+            reserve(usedCells + 1);
+            cell = usedCells++;
+        }
+        
+        if (position < 0 || position > (int)cells.size())
+            position = (int)cells.size();
+        
+        cells.insert(cells.begin() + position, cell);
+        
+        return cell;
+    }
+    
+    void erase(int position)
+    {
+        freeCells.push_back(cells[position]);
+        cells.erase(cells.begin() + position);
+    }
+    
+    /* Replaces contents with a GPU-side copy of 'other' */
+    void copy(FrameStrip &other)
+    {
+        setup(other.width, other.height);
+        
+        try
+        {
+            for (TEXFBO &src : other.pages)
+            {
+                TEXFBO page = shState->texPool().request(src.width, src.height);
+                pages.push_back(page);
+                
+                GLMeta::blitBegin(page);
+                GLMeta::blitSource(src);
+                GLMeta::blitRectangle(IntRect(0, 0, src.width, src.height), Vec2i());
+                GLMeta::blitEnd();
+            }
+        }
+        catch (const Exception &e)
+        {
+            clear();
+            throw e;
+        }
+        
+        cells = other.cells;
+        freeCells = other.freeCells;
+        usedCells = other.usedCells;
+        capacity = other.capacity;
+    }
+    
+    void clear()
+    {
+        for (TEXFBO &page : pages)
+            shState->texPool().release(page);
+        
+        pages.clear();
+        cells.clear();
+        freeCells.clear();
+        
+        usedCells = 0;
+        capacity = 0;
+    }
+    
+private:
+    TEXFBO allocPage(int cellCount)
+    {
+        int c = std::min(cellCount, cols);
+        int r = (cellCount + cols - 1) / cols;
+        
+        return shState->texPool().request(c * width, r * height);
+    }
+};
+
+/* Saves the framebuffer and texture bindings, restoring them once it
+ * goes out of scope. The frame view of an animated bitmap may be
+ * resolved, and queued drawing flushed, in the middle of drawing or
+ * of another blit (eg. as a blit source), neither of which may be
+ * disturbed by doing so */
+struct BindingSnapshot
+{
+    GLint fbo, readFBO, tex;
+    
+    BindingSnapshot()
+    : readFBO(0)
+    {
+        gl.GetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+        gl.GetIntegerv(GL_TEXTURE_BINDING_2D, &tex);
+        
+        if (gl.BlitFramebuffer)
+            gl.GetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFBO);
+    }
+    
+    ~BindingSnapshot()
+    {
+        gl.BindTexture(GL_TEXTURE_2D, tex);
+        gl.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+        
+        if (gl.BlitFramebuffer)
+            gl.BindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    }
+};
+
+/* Copies pixels between an animated bitmap's frame strip and its
+ * frame view, without going through the blit pipeline */
+static void copyFramePixels(FBO::ID srcFBO, const IntRect &srcRect,
+                            TEX::ID dstTex, const Vec2i &dstPos)
+{
+    FBO::bind(srcFBO);
+    TEX::bind(dstTex);
+    gl.CopyTexSubImage2D(GL_TEXTURE_2D, 0, dstPos.x, dstPos.y,
+                         srcRect.x, srcRect.y, srcRect.w, srcRect.h);
+}
+
+/* A run of queued quads sharing the same kind (and source
+ * bitmap), which is drawn in one call */
+struct DeferredBatch
+{
+    enum Kind
+    {
+        Fill,
+        Blit
+    };
+    
+    Kind kind;
+    const Bitmap *source;
+    size_t first, count;
+};
+
+/* Reference count of a texture set shared between
+ * a bitmap and its clones */
+struct TextureShare
+{
+    int refCount;
+};
+
+struct BitmapPrivate;
+
+/* Bitmaps with queued deferred commands */
+static std::vector<BitmapPrivate*> deferredBitmaps;
+
 struct BitmapPrivate
 {
     Bitmap *self;
@@ -165,7 +430,7 @@ struct BitmapPrivate
         bool playing;
         bool needsReset;
         bool loop;
-        std::vector<TEXFBO> frames;
+        FrameStrip frames;
         float fps;
         int lastFrame;
         double startTime, playTime;
@@ -181,9 +446,9 @@ struct BitmapPrivate
             return (loop) ? fmod(i, frames.size()) : (i > (int)frames.size() - 1) ? (int)frames.size() - 1 : i;
         }
         
-        inline TEXFBO &currentFrame() {
+        inline int currentCell() {
             int i = currentFrameI();
-            return frames[i];
+            return frames.cells[i];
         }
         
         inline void play() {
@@ -220,13 +485,22 @@ struct BitmapPrivate
     TEXFBO frontBuffer;
     TEXFBO backBuffer;
     
+    /* Standalone copy of the current animation frame, for users
+     * that can't sample from the frame strip (framebuffer blits,
+     * wrapping samplers, drawing into the bitmap). Resolved on
+     * demand and written back into the strip on modification */
+    TEXFBO frameView;
+    int frameViewCell;
+    
     Font *font;
     
     /* "Mega surfaces" are a hack to allow Tilesets to be used
      * whose Bitmaps don't fit into a regular texture. They're
-     * kept in RAM and will throw an error if they're used in
-     * any context other than as Tilesets */
-    SDL_Surface *megaSurface;
+     * split into a row-major grid of textures, and can be read
+     * and drawn from, but will throw an error if drawn to */
+    std::vector<TEXFBO> megaTiles;
+    int megaTileCols;
+    Vec2i megaSize;
     
     /* A cached version of the bitmap in client memory, for
      * getPixel calls. Is invalidated any time the bitmap
@@ -234,6 +508,11 @@ struct BitmapPrivate
     SDL_Surface *surface;
     SDL_PixelFormat *format;
     
+    /* While the surface is mapped into script memory, it
+     * must stay alive; it is only dropped once unmapped */
+    int mappedPixels;
+    bool surfaceStale;
+    
     /* The 'tainted' area describes which parts of the
      * bitmap are not cleared, ie. don't have 0 opacity.
      * If we're blitting / drawing text to a cleared part
@@ -242,10 +521,35 @@ struct BitmapPrivate
      * ourselves the expensive blending calculation */
     pixman_region16_t tainted;
     
+    /* Fills, gradient fills and unscaled opaque blits into
+     * cleared areas all plainly overwrite pixels, so instead of
+     * being drawn right away they are queued here and drawn
+     * with as few draw calls as possible once the bitmap is
+     * read, at prepareDraw, or on an explicit flush */
+    ColorQuadArray *deferredQuads;
+    std::vector<DeferredBatch> deferredBatches;
+    
+    /* Bounding box of the queued quads */
+    IntRect deferredBounds;
+    
+    /* Clones start out using their source's textures; whichever
+     * bitmap is written to first makes itself a private copy */
+    TextureShare *texShare;
+    
+    /* Small bitmaps loaded from disk start out in a shared atlas
+     * page; 'gl' then only holds their size. Anything other than
+     * plain sampling moves them into a texture of their own */
+    SpriteAtlas::Slot atlasSlot;
+    
     BitmapPrivate(Bitmap *self)
     : self(self),
-    megaSurface(0),
-    surface(0)
+    deferredQuads(0),
+    texShare(0),
+    frameViewCell(-1),
+    megaTileCols(0),
+    surface(0),
+    mappedPixels(0),
+    surfaceStale(false)
     {
         format = SDL_AllocFormat(SDL_PIXELFORMAT_ABGR8888);
         
@@ -267,13 +571,103 @@ struct BitmapPrivate
     
     ~BitmapPrivate()
     {
+        dropDeferred();
+        delete deferredQuads;
+        
         prepareCon.disconnect();
         SDL_FreeFormat(format);
         pixman_region_fini(&tainted);
     }
     
     TEXFBO &getGLTypes() {
-        return (animation.enabled) ? animation.currentFrame() : gl;
+        if (animation.enabled)
+            return resolveFrameView();
+        
+        leaveAtlas();
+        
+        return gl;
+    }
+    
+    bool inAtlas() const
+    {
+        return atlasSlot.page >= 0;
+    }
+    
+    void leaveAtlas()
+    {
+        if (!inAtlas())
+            return;
+        
+        /* May happen in the middle of drawing */
+        BindingSnapshot snapshot;
+        
+        TEXFBO own = shState->texPool().request(gl.width, gl.height);
+        
+        copyFramePixels(shState->spriteAtlas().page(atlasSlot).fbo, atlasSlot.rect,
+                        own.tex, Vec2i());
+        
+        shState->spriteAtlas().remove(atlasSlot);
+        gl = own;
+    }
+    
+    /* Atlas entries get their scratch buffers on demand */
+    void ensureScratch()
+    {
+        if (frontBuffer.tex != TEX::ID(0))
+            return;
+        
+        BindingSnapshot snapshot;
+        
+        frontBuffer = shState->texPool().request(gl.width, gl.height);
+        backBuffer = shState->texPool().request(gl.width, gl.height);
+    }
+    
+    TEXFBO &resolveFrameView()
+    {
+        int cell = animation.currentCell();
+        
+        if (cell == frameViewCell)
+            return frameView;
+        
+        BindingSnapshot snapshot;
+        
+        if (frameView.tex.gl == 0)
+            frameView = shState->texPool().request(animation.width, animation.height);
+        
+        copyFramePixels(animation.frames.page(cell).fbo, animation.frames.cellRect(cell),
+                        frameView.tex, Vec2i());
+        
+        frameViewCell = cell;
+        
+        return frameView;
+    }
+    
+    /* Must be called whenever frames are added, removed
+     * or moved, as the view's cell may have been reused */
+    void invalidateFrameView()
+    {
+        frameViewCell = -1;
+    }
+    
+    void releaseFrameView()
+    {
+        if (frameView.tex.gl != 0)
+            shState->texPool().release(frameView);
+        
+        frameView = TEXFBO();
+        frameViewCell = -1;
+    }
+    
+    void writeBackFrameView()
+    {
+        if (frameViewCell < 0)
+            return;
+        
+        BindingSnapshot snapshot;
+        
+        copyFramePixels(frameView.fbo, IntRect(0, 0, frameView.width, frameView.height),
+                        animation.frames.page(frameViewCell).tex,
+                        animation.frames.cellRect(frameViewCell).pos());
     }
 
     void pingpongBind() {
@@ -287,11 +681,286 @@ struct BitmapPrivate
     
     void prepare()
     {
+        flushDeferred();
+        
         if (!animation.enabled || !animation.playing) return;
         
         animation.updateTimer();
     }
     
+    bool canDefer() const
+    {
+        return !animation.enabled && !isMega();
+    }
+    
+    /* Appends a quad to the queue, extending the last
+     * batch if it is compatible */
+    Vertex *deferQuad(const IntRect &rect, DeferredBatch::Kind kind,
+                      const Bitmap *source = 0)
+    {
+        if (!deferredQuads)
+            deferredQuads = new ColorQuadArray;
+        
+        IntRect norm = normalizedRect(rect);
+        
+        if (deferredBatches.empty())
+        {
+            deferredBitmaps.push_back(this);
+            deferredBounds = norm;
+        }
+        else
+        {
+            int x2 = std::max(deferredBounds.x + deferredBounds.w, norm.x + norm.w);
+            int y2 = std::max(deferredBounds.y + deferredBounds.h, norm.y + norm.h);
+            
+            deferredBounds.x = std::min(deferredBounds.x, norm.x);
+            deferredBounds.y = std::min(deferredBounds.y, norm.y);
+            deferredBounds.w = x2 - deferredBounds.x;
+            deferredBounds.h = y2 - deferredBounds.y;
+        }
+        
+        size_t quad = deferredQuads->count();
+        
+        if (deferredBatches.empty() ||
+            deferredBatches.back().kind != kind ||
+            deferredBatches.back().source != source)
+        {
+            DeferredBatch batch = { kind, source, quad, 0 };
+            deferredBatches.push_back(batch);
+        }
+        
+        deferredBatches.back().count++;
+        deferredQuads->resize(quad + 1);
+        
+        return &deferredQuads->vertices[quad*4];
+    }
+    
+    void deferFill(const IntRect &rect, const Vec4 &color)
+    {
+        Vertex *vert = deferQuad(rect, DeferredBatch::Fill);
+        Quad::setPosRect(vert, rect);
+        Quad::setColor(vert, color);
+    }
+    
+    void deferGradientFill(const IntRect &rect, const Vec4 &color1,
+                           const Vec4 &color2, bool vertical)
+    {
+        Vertex *vert = deferQuad(rect, DeferredBatch::Fill);
+        Quad::setPosRect(vert, rect);
+        
+        vert[0].color = color1;
+        vert[1].color = vertical ? color1 : color2;
+        vert[2].color = color2;
+        vert[3].color = vertical ? color2 : color1;
+    }
+    
+    void deferBlit(const Bitmap &source, const IntRect &srcRect, const IntRect &destRect)
+    {
+        Vertex *vert = deferQuad(destRect, DeferredBatch::Blit, &source);
+        Quad::setTexPosRect(vert, srcRect, destRect);
+        Quad::setColor(vert, Vec4(1, 1, 1, 1));
+    }
+    
+    void dropDeferred()
+    {
+        if (deferredBatches.empty())
+            return;
+        
+        deferredBatches.clear();
+        deferredQuads->clear();
+        
+        deferredBitmaps.erase(std::find(deferredBitmaps.begin(),
+                                        deferredBitmaps.end(), this));
+    }
+    
+    /* Also reached from getGLTypes() while a shader is being
+     * set up for drawing elsewhere, so the bindings, program
+     * and viewport are left as they were. The uniforms of the
+     * simple shaders aren't, which is why blit passes have to
+     * flush their sources before GLMeta::blitBegin */
+    void flushDeferred()
+    {
+        if (deferredBatches.empty())
+            return;
+        
+        BindingSnapshot snapshot;
+        
+        deferredQuads->commit();
+        
+        FBO::bind(gl.fbo);
+        glState.program.push();
+        glState.blend.pushSet(false);
+        glState.viewport.pushSet(IntRect(0, 0, gl.width, gl.height));
+        
+        for (size_t i = 0; i < deferredBatches.size(); ++i)
+        {
+            const DeferredBatch &batch = deferredBatches[i];
+            
+            if (batch.kind == DeferredBatch::Fill)
+            {
+                SimpleColorShader &shader = shState->shaders().simpleColor;
+                shader.bind();
+                shader.setTranslation(Vec2i());
+                shader.applyViewportProj();
+            }
+            else
+            {
+                SimpleShader &shader = shState->shaders().simple;
+                shader.bind();
+                shader.setTranslation(Vec2i());
+                shader.applyViewportProj();
+                
+                batch.source->bindTex(shader);
+                TEX::setSmooth(false);
+            }
+            
+            deferredQuads->draw(batch.first, batch.count);
+        }
+        
+        glState.viewport.pop();
+        glState.blend.pop();
+        glState.program.pop();
+        
+        dropDeferred();
+    }
+    
+    /* Flushes other bitmaps with queued blits from this one */
+    void flushReaders()
+    {
+        for (size_t i = 0; i < deferredBitmaps.size();)
+        {
+            BitmapPrivate *other = deferredBitmaps[i];
+            bool reads = false;
+            
+            for (size_t j = 0; j < other->deferredBatches.size() && other != this; ++j)
+                if (other->deferredBatches[j].source == self)
+                    reads = true;
+            
+            if (!reads)
+            {
+                ++i;
+                continue;
+            }
+            
+            /* Removes it from the list */
+            other->flushDeferred();
+        }
+    }
+    
+    /* Must precede any change to the pixels that doesn't go
+     * through the queue (or, with 'deferring', that does) */
+    void prepareWrite(bool deferring = false)
+    {
+        if (!deferredBitmaps.empty())
+            flushReaders();
+        
+        if (!deferring)
+            flushDeferred();
+        
+        leaveAtlas();
+        
+        /* A clone gets its own scratch buffers here; allocating
+         * them first would orphan them */
+        makeExclusive();
+        ensureScratch();
+    }
+    
+    /* For a write that neither reads nor changes pixels outside
+     * of 'area'. The queue only has to be drawn first if it
+     * draws there too; otherwise the order doesn't matter */
+    void prepareWrite(const IntRect &area)
+    {
+        bool overlaps = !deferredBatches.empty() &&
+                        SDL_HasIntersection(&area, &deferredBounds);
+        
+        prepareWrite(!overlaps);
+    }
+    
+    void shareTextures(BitmapPrivate &other)
+    {
+        if (!other.texShare)
+        {
+            other.texShare = new TextureShare;
+            other.texShare->refCount = 1;
+        }
+        
+        texShare = other.texShare;
+        texShare->refCount++;
+        
+        gl = other.gl;
+        frontBuffer = other.frontBuffer;
+        backBuffer = other.backBuffer;
+    }
+    
+    /* Returns whether the textures are now owned by us alone */
+    bool unshareTextures()
+    {
+        if (!texShare)
+            return true;
+        
+        bool last = (--texShare->refCount == 0);
+        
+        if (last)
+            delete texShare;
+        
+        texShare = 0;
+        
+        return last;
+    }
+    
+    void makeExclusive()
+    {
+        if (!texShare)
+            return;
+        
+        if (texShare->refCount == 1)
+        {
+            unshareTextures();
+            return;
+        }
+        
+        unshareTextures();
+        
+        TEXFBO shared = gl;
+        
+        gl = shState->texPool().request(shared.width, shared.height);
+        frontBuffer = shState->texPool().request(shared.width, shared.height);
+        backBuffer = shState->texPool().request(shared.width, shared.height);
+        
+        GLMeta::blitBegin(gl);
+        GLMeta::blitSource(shared);
+        GLMeta::blitRectangle(IntRect(0, 0, shared.width, shared.height), Vec2i());
+        GLMeta::blitEnd();
+    }
+    
+    /* Makes sure 'surface' mirrors the texture */
+    void readSurface()
+    {
+        flushDeferred();
+        
+        if (surface)
+            return;
+        
+        allocSurface();
+        
+        IntRect area(0, 0, gl.width, gl.height);
+        FBO::ID fbo = gl.fbo;
+        
+        if (inAtlas())
+        {
+            area = atlasSlot.rect;
+            fbo = shState->spriteAtlas().page(atlasSlot).fbo;
+        }
+        
+        FBO::bind(fbo);
+        
+        glState.viewport.pushSet(IntRect(0, 0, gl.width, gl.height));
+        
+        ::gl.ReadPixels(area.x, area.y, area.w, area.h, GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels);
+        
+        glState.viewport.pop();
+    }
+    
     void allocSurface()
     {
         surface = SDL_CreateRGBSurface(0, gl.width, gl.height, format->BitsPerPixel,
@@ -339,21 +1008,76 @@ struct BitmapPrivate
         return result != PIXMAN_REGION_OUT;
     }
     
-    void bindTexture(ShaderBase &shader)
+    /* Returns the texture the content can be sampled from,
+     * with 'offset' receiving its position inside of it. Unless
+     * 'shared' is set, it is moved into a texture of its own */
+    TEXFBO &sampleSource(Vec2i &offset, bool shared = true)
     {
-        if (animation.enabled) {
-            TEXFBO cframe = animation.currentFrame();
-            TEX::bind(cframe.tex);
-            shader.setTexSize(Vec2i(cframe.width, cframe.height));
-            return;
+        offset = Vec2i();
+        
+        if (animation.enabled && shared) {
+            int cell = animation.currentCell();
+            offset = animation.frames.cellRect(cell).pos();
+            return animation.frames.page(cell);
         }
-        TEX::bind(gl.tex);
-        shader.setTexSize(Vec2i(gl.width, gl.height));
+        if (inAtlas() && shared) {
+            offset = atlasSlot.rect.pos();
+            return shState->spriteAtlas().page(atlasSlot);
+        }
+        return getGLTypes();
+    }
+    
+    void bindTexture(ShaderBase &shader, bool isolated = false)
+    {
+        /* Atlas entries are only sampled in place by shaders
+         * that know about the offset; frames always are */
+        bool shared = !isolated &&
+        (animation.enabled || shader.hasFrameOffset());
+        
+        Vec2i offset;
+        TEXFBO &tex = sampleSource(offset, shared);
+        TEX::bind(tex.tex);
+        shader.setTexSize(Vec2i(tex.width, tex.height), offset);
     }
     
     void bindFBO()
     {
-        FBO::bind((animation.enabled) ? animation.currentFrame().fbo : gl.fbo);
+        FBO::bind(getGLTypes().fbo);
+    }
+    
+    /* Averages 'samples' copies of the bitmap, rotated and
+     * scaled around its center, in a single draw */
+    void sampleBlur(float baseAngle, float angleStep, float zoomStep, int samples)
+    {
+        prepareWrite();
+        
+        Quad &quad = shState->gpQuad();
+        FloatRect rect(0, 0, gl.width, gl.height);
+        quad.setTexPosRect(rect, rect);
+        
+        RadialBlurShader &shader = shState->shaders().radialBlur;
+        shader.bind();
+        shader.setSamples(samples);
+        shader.setAngle(baseAngle, angleStep);
+        shader.setZoomStep(zoomStep);
+        
+        bindTexture(shader);
+        TEX::setSmooth(true);
+        FBO::bind(frontBuffer.fbo);
+        
+        glState.blend.pushSet(false);
+        pushSetViewport(shader);
+        
+        quad.draw();
+        
+        popViewport();
+        glState.blend.pop();
+        
+        TEX::setSmooth(false);
+        
+        std::swap(gl, frontBuffer);
+        
+        onModified();
     }
     
     void pushSetViewport(ShaderBase &shader) const
@@ -374,6 +1098,138 @@ struct BitmapPrivate
         glState.blend.pop();
     }
     
+    /* Draws 'srcRect' of 'source' into 'destRect', blending with
+     * the existing contents the way RMXP's blt does */
+    void blitTexture(TEXFBO &source, const IntRect &srcRect,
+                     const IntRect &destRect, int opacity)
+    {
+        if (opacity == 255 && !touchesTaintedArea(destRect))
+        {
+            /* Fast blit */
+            GLMeta::blitBegin(getGLTypes());
+            GLMeta::blitSource(source);
+            GLMeta::blitRectangle(srcRect, destRect);
+            GLMeta::blitEnd();
+            
+            return;
+        }
+        
+        /* Fragment pipeline */
+        float normOpacity = (float) opacity / 255.0f;
+        
+        TEXFBO &gpTex = shState->gpTexFBO(destRect.w, destRect.h);
+        
+        GLMeta::blitBegin(gpTex);
+        GLMeta::blitSource(getGLTypes());
+        GLMeta::blitRectangle(destRect, Vec2i());
+        GLMeta::blitEnd();
+        
+        FloatRect bltSubRect((float) srcRect.x / source.width,
+                             (float) srcRect.y / source.height,
+                             ((float) source.width / srcRect.w) * ((float) destRect.w / gpTex.width),
+                             ((float) source.height / srcRect.h) * ((float) destRect.h / gpTex.height));
+        
+        BltShader &shader = shState->shaders().blt;
+        shader.bind();
+        shader.setDestination(gpTex.tex);
+        shader.setSubRect(bltSubRect);
+        shader.setOpacity(normOpacity);
+        
+        Quad &quad = shState->gpQuad();
+        quad.setTexPosRect(srcRect, destRect);
+        quad.setColor(Vec4(1, 1, 1, normOpacity));
+        
+        TEX::bind(source.tex);
+        shader.setTexSize(Vec2i(source.width, source.height));
+        bindFBO();
+        pushSetViewport(shader);
+        
+        blitQuad(quad);
+        
+        popViewport();
+    }
+    
+    bool isMega() const
+    {
+        return !megaTiles.empty();
+    }
+    
+    /* Splits 'surf' into tiles no larger than the max
+     * texture size and uploads them. 'surf' isn't needed
+     * afterwards */
+    void uploadMegaTiles(SDL_Surface *surf)
+    {
+        int size = glState.caps.maxTexSize;
+        int cols = (surf->w + size - 1) / size;
+        int rows = (surf->h + size - 1) / size;
+        
+        megaTileCols = cols;
+        megaSize = Vec2i(surf->w, surf->h);
+        
+        try
+        {
+            for (int i = 0; i < cols * rows; ++i)
+            {
+                IntRect rect = megaTileRect(i);
+                TEXFBO tile = shState->texPool().request(rect.w, rect.h);
+                megaTiles.push_back(tile);
+                
+                TEX::bind(tile.tex);
+                GLMeta::subRectImageUpload(surf->w, rect.x, rect.y, 0, 0,
+                                           rect.w, rect.h, surf, GL_RGBA);
+            }
+        }
+        catch (const Exception &e)
+        {
+            GLMeta::subRectImageEnd();
+            releaseMegaTiles();
+            throw e;
+        }
+        
+        GLMeta::subRectImageEnd();
+    }
+    
+    void releaseMegaTiles()
+    {
+        for (TEXFBO &tile : megaTiles)
+            shState->texPool().release(tile);
+        
+        megaTiles.clear();
+    }
+    
+    /* Area of tile 'i' in bitmap coordinates */
+    IntRect megaTileRect(int i) const
+    {
+        int size = glState.caps.maxTexSize;
+        int x = (i % megaTileCols) * size;
+        int y = (i / megaTileCols) * size;
+        
+        return IntRect(x, y,
+                       std::min(size, megaSize.x - x),
+                       std::min(size, megaSize.y - y));
+    }
+    
+    /* Reads the tiles back into 'output', which holds
+     * (megaSize.x * megaSize.y) RGBA pixels */
+    void readMegaTiles(uint8_t *output)
+    {
+        const int pitch = megaSize.x * 4;
+        std::vector<uint8_t> buffer;
+        
+        for (size_t i = 0; i < megaTiles.size(); ++i)
+        {
+            IntRect rect = megaTileRect(i);
+            buffer.resize(rect.w * rect.h * 4);
+            
+            FBO::bind(megaTiles[i].fbo);
+            ::gl.ReadPixels(0, 0, rect.w, rect.h, GL_RGBA, GL_UNSIGNED_BYTE, &buffer[0]);
+            
+            for (int y = 0; y < rect.h; ++y)
+                memcpy(output + (rect.y + y) * pitch + rect.x * 4,
+                       &buffer[y * rect.w * 4], rect.w * 4);
+        }
+    }
+    
     void fillRect(const IntRect &rect,
                   const Vec4 &color)
     {
@@ -402,10 +1258,20 @@ struct BitmapPrivate
     
     void onModified(bool freeSurface = true)
     {
+        if (animation.enabled)
+            writeBackFrameView();
+        
         if (surface && freeSurface)
         {
-            SDL_FreeSurface(surface);
-            surface = 0;
+            if (mappedPixels > 0)
+            {
+                surfaceStale = true;
+            }
+            else
+            {
+                SDL_FreeSurface(surface);
+                surface = 0;
+            }
         }
         
         self->modified();
@@ -543,12 +1409,28 @@ Bitmap::Bitmap(const char *filename)
         if (fcount > fcount_partial) {
             Debug() << "Non-fatal error reading" << filename << ": Only decoded" << fcount_partial << "out of" << fcount << "frames";
         }
+        FrameStrip &frames = p->animation.frames;
+        
+        try {
+            frames.setup(p->animation.width, p->animation.height);
+            frames.reserve(fcount_partial);
+        }
+        catch (const Exception &e)
+        {
+            frames.clear();
+            
+            gif_finalise(handler.gif);
+            delete handler.gif;
+            delete handler.gif_data;
+            
+            throw e;
+        }
+        
         for (int i = 0; i < fcount_partial; i++) {
             if (i > 0) {
                 int status = gif_decode_frame(handler.gif, i);
                 if (status != GIF_OK && status != GIF_WORKING) {
-                    for (TEXFBO &frame : p->animation.frames)
-                        shState->texPool().release(frame);
+                    frames.clear();
                     
                     gif_finalise(handler.gif);
                     delete handler.gif;
@@ -559,25 +1441,12 @@ Bitmap::Bitmap(const char *filename)
                 }
             }
             
-            TEXFBO texfbo;
-            try {
-                texfbo = shState->texPool().request(p->animation.width, p->animation.height);
-            }
-            catch (const Exception &e)
-            {
-                for (TEXFBO &frame : p->animation.frames)
-                    shState->texPool().release(frame);
-                
-                gif_finalise(handler.gif);
-                delete handler.gif;
-                delete handler.gif_data;
-                
-                throw e;
-            }
+            int cell = frames.insert(-1);
+            IntRect cellRect = frames.cellRect(cell);
             
-            TEX::bind(texfbo.tex);
-            TEX::uploadImage(p->animation.width, p->animation.height, handler.gif->frame_image, GL_RGBA);
-            p->animation.frames.push_back(texfbo);
+            TEX::bind(frames.page(cell).tex);
+            TEX::uploadSubImage(cellRect.x, cellRect.y, cellRect.w, cellRect.h,
+                                handler.gif->frame_image, GL_RGBA);
         }
         
         gif_finalise(handler.gif);
@@ -592,12 +1461,35 @@ Bitmap::Bitmap(const char *filename)
     
     p->ensureFormat(imgSurf, SDL_PIXELFORMAT_ABGR8888);
     
+    SpriteAtlas::Slot atlasSlot;
+    
     if (imgSurf->w > glState.caps.maxTexSize || imgSurf->h > glState.caps.maxTexSize)
     {
         /* Mega surface */
         p = new BitmapPrivate(this);
-        p->megaSurface = imgSurf;
-        SDL_SetSurfaceBlendMode(p->megaSurface, SDL_BLENDMODE_NONE);
+        
+        try
+        {
+            p->uploadMegaTiles(imgSurf);
+        }
+        catch (const Exception &e)
+        {
+            SDL_FreeSurface(imgSurf);
+            delete p;
+            throw e;
+        }
+        
+        /* Only the tiles are kept */
+        SDL_FreeSurface(imgSurf);
+    }
+    else if (shState->spriteAtlas().insert(imgSurf, atlasSlot))
+    {
+        p = new BitmapPrivate(this);
+        p->atlasSlot = atlasSlot;
+        p->gl.width = imgSurf->w;
+        p->gl.height = imgSurf->h;
+        
+        SDL_FreeSurface(imgSurf);
     }
     else
     {
@@ -666,8 +1558,20 @@ Bitmap::Bitmap(void *pixeldata, int width, int height)
     if (surface->w > glState.caps.maxTexSize || surface->h > glState.caps.maxTexSize)
     {
         p = new BitmapPrivate(this);
-        p->megaSurface = surface;
-        SDL_SetSurfaceBlendMode(p->megaSurface, SDL_BLENDMODE_NONE);
+        
+        try
+        {
+            p->uploadMegaTiles(surface);
+        }
+        catch (const Exception &e)
+        {
+            SDL_FreeSurface(surface);
+            delete p;
+            throw e;
+        }
+        
+        /* Only the tiles are kept */
+        SDL_FreeSurface(surface);
     }
     else
     {
@@ -711,21 +1615,28 @@ Bitmap::Bitmap(const Bitmap &other, int frame)
     p = new BitmapPrivate(this);
     
     // TODO: Clean me up
-    if (!other.isAnimated() || frame >= -1) {
+    if (!other.isAnimated()) {
+        // Flush anything pending before sharing the textures
+        other.getGLTypes();
+        p->shareTextures(*other.p);
+    }
+    else if (frame >= -1) {
         p->gl = shState->texPool().request(other.width(), other.height());
         p->frontBuffer = shState->texPool().request(other.width(), other.height());
         p->backBuffer = shState->texPool().request(other.width(), other.height());
         
         GLMeta::blitBegin(p->gl);
         // Blit just the current frame of the other animated bitmap
-        if (!other.isAnimated() || frame == -1) {
+        if (frame == -1) {
             GLMeta::blitSource(other.getGLTypes());
+            GLMeta::blitRectangle(rect(), rect(), true);
         }
         else {
-            auto &frames = other.getFrames();
-            GLMeta::blitSource(frames[clamp(frame, 0, (int)frames.size() - 1)]);
+            FrameStrip &frames = other.p->animation.frames;
+            int cell = frames.cells[clamp(frame, 0, (int)frames.size() - 1)];
+            GLMeta::blitSource(frames.page(cell));
+            GLMeta::blitRectangle(frames.cellRect(cell), rect(), true);
         }
-        GLMeta::blitRectangle(rect(), rect(), true);
         GLMeta::blitEnd();
     }
     else {
@@ -738,23 +1649,7 @@ Bitmap::Bitmap(const Bitmap &other, int frame)
         p->animation.startTime = 0;
         p->animation.loop = other.getLooping();
         
-        for (TEXFBO &sourceframe : other.getFrames()) {
-            TEXFBO newframe;
-            try {
-                newframe = shState->texPool().request(p->animation.width, p->animation.height);
-            } catch(const Exception &e) {
-                for (TEXFBO &f : p->animation.frames)
-                    shState->texPool().release(f);
-                throw e;
-            }
-            
-            GLMeta::blitBegin(newframe);
-            GLMeta::blitSource(sourceframe);
-            GLMeta::blitRectangle(rect(), rect(), true);
-            GLMeta::blitEnd();
-            
-            p->animation.frames.push_back(newframe);
-        }
+        p->animation.frames.copy(other.p->animation.frames);
     }
     
     p->addTaintedArea(rect());
@@ -762,15 +1657,15 @@ Bitmap::Bitmap(const Bitmap &other, int frame)
 
 Bitmap::~Bitmap()
 {
-    dispose();
+    Disposable::dispose();
 }
 
 int Bitmap::width() const
 {
     guardDisposed();
     
-    if (p->megaSurface) {
-        return p->megaSurface->w;
+    if (p->isMega()) {
+        return p->megaSize.x;
     }
     
     if (p->animation.enabled) {
@@ -784,8 +1679,8 @@ int Bitmap::height() const
 {
     guardDisposed();
     
-    if (p->megaSurface)
-        return p->megaSurface->h;
+    if (p->isMega())
+        return p->megaSize.y;
     
     if (p->animation.enabled)
         return p->animation.height;
@@ -796,7 +1691,7 @@ int Bitmap::height() const
 bool Bitmap::isMega() const{
     guardDisposed();
     
-    return p->megaSurface;
+    return p->isMega();
 }
 
 bool Bitmap::isAnimated() const {
@@ -852,128 +1747,88 @@ void Bitmap::stretchBlt(const IntRect &destRect,
     if (opacity == 0)
         return;
     
-    SDL_Surface *srcSurf = source.megaSurface();
-    
-    if (srcSurf && shState->config().subImageFix)
+    /* Sampling past the edges of an atlas entry
+     * would pick up its neighbours */
+    if (source.p->inAtlas())
     {
-        /* Blit from software surface, for broken GL drivers */
-        Vec2i gpTexSize;
-        shState->ensureTexSize(sourceRect.w, sourceRect.h, gpTexSize);
-        shState->bindTex();
-        
-        GLMeta::subRectImageUpload(srcSurf->w, sourceRect.x, sourceRect.y, 0, 0,
-                                   sourceRect.w, sourceRect.h, srcSurf, GL_RGBA);
-        GLMeta::subRectImageEnd();
-        
-        SimpleShader &shader = shState->shaders().simple;
-        shader.bind();
-        shader.setTranslation(Vec2i());
-        shader.setTexSize(gpTexSize);
+        IntRect norm = normalizedRect(sourceRect);
         
-        p->pushSetViewport(shader);
-        p->bindFBO();
-        
-        Quad &quad = shState->gpQuad();
-        quad.setTexRect(FloatRect(0, 0, sourceRect.w, sourceRect.h));
-        quad.setPosRect(destRect);
-        
-        p->blitQuad(quad);
-        p->popViewport();
+        if (norm.x < 0 || norm.y < 0 ||
+            norm.x + norm.w > source.width() || norm.y + norm.h > source.height())
+            source.getGLTypes();
+    }
+    
+    if (p->canDefer() && source.p->canDefer() && &source != this &&
+        opacity == 255 && !p->touchesTaintedArea(destRect) &&
+        sourceRect.w == destRect.w && sourceRect.h == destRect.h &&
+        sourceRect.w > 0 && sourceRect.h > 0)
+    {
+        /* Unscaled copy into a cleared area */
+        source.p->flushDeferred();
+        p->prepareWrite(true);
+        p->deferBlit(source, sourceRect, destRect);
         
         p->addTaintedArea(destRect);
         p->onModified();
         
         return;
     }
-    else if (srcSurf)
+    
+    p->prepareWrite();
+    
+    if (source.p->isMega())
     {
-        /* Blit from software surface */
-        /* Don't do transparent blits for now */
-        if (opacity < 255)
-            source.ensureNonMega();
-        
-        SDL_Rect srcRect = sourceRect;
-        SDL_Rect dstRect = destRect;
-        SDL_Rect btmRect = { 0, 0, width(), height() };
-        SDL_Rect bltRect;
+        /* Blit from the GPU tiles of a mega surface, splitting
+         * the operation at tile borders */
+        IntRect srcRect = normalizedRect(sourceRect);
+        IntRect dstRect = normalizedRect(destRect);
         
-        if (SDL_IntersectRect(&btmRect, &dstRect, &bltRect) != SDL_TRUE)
+        if (srcRect.w == 0 || srcRect.h == 0)
             return;
         
-        int bpp;
-        Uint32 rMask, gMask, bMask, aMask;
-        SDL_PixelFormatEnumToMasks(SDL_PIXELFORMAT_ABGR8888,
-                                   &bpp, &rMask, &gMask, &bMask, &aMask);
-        SDL_Surface *blitTemp =
-        SDL_CreateRGBSurface(0, destRect.w, destRect.h, bpp, rMask, gMask, bMask, aMask);
-        
-        SDL_BlitScaled(srcSurf, &srcRect, blitTemp, 0);
+        float scaleX = (float) dstRect.w / srcRect.w;
+        float scaleY = (float) dstRect.h / srcRect.h;
         
-        TEX::bind(getGLTypes().tex);
-        
-        if (bltRect.w == dstRect.w && bltRect.h == dstRect.h)
-        {
-            /* Dest rectangle lies within bounding box */
-            TEX::uploadSubImage(destRect.x, destRect.y,
-                                destRect.w, destRect.h,
-                                blitTemp->pixels, GL_RGBA);
-        }
-        else
+        for (size_t i = 0; i < source.p->megaTiles.size(); ++i)
         {
-            /* Clipped blit */
-            GLMeta::subRectImageUpload(blitTemp->w, bltRect.x - dstRect.x, bltRect.y - dstRect.y,
-                                       bltRect.x, bltRect.y, bltRect.w, bltRect.h, blitTemp, GL_RGBA);
-            GLMeta::subRectImageEnd();
+            IntRect tileRect = source.p->megaTileRect(i);
+            SDL_Rect part;
+            
+            if (!SDL_IntersectRect(&srcRect, &tileRect, &part))
+                continue;
+            
+            /* Round the part's edges (not its size), so that
+             * scaled neighbours meet without gaps */
+            int x1 = dstRect.x + lround((part.x - srcRect.x) * scaleX);
+            int y1 = dstRect.y + lround((part.y - srcRect.y) * scaleY);
+            int x2 = dstRect.x + lround((part.x + part.w - srcRect.x) * scaleX);
+            int y2 = dstRect.y + lround((part.y + part.h - srcRect.y) * scaleY);
+            
+            if (x1 == x2 || y1 == y2)
+                continue;
+            
+            p->blitTexture(source.p->megaTiles[i],
+                           IntRect(part.x - tileRect.x, part.y - tileRect.y, part.w, part.h),
+                           IntRect(x1, y1, x2 - x1, y2 - y1), opacity);
         }
         
-        SDL_FreeSurface(blitTemp);
-        
+        p->addTaintedArea(dstRect);
         p->onModified();
+        
         return;
     }
     
-    if (opacity == 255 && !p->touchesTaintedArea(destRect))
+    if (source.p->inAtlas())
     {
-        /* Fast blit */
-        GLMeta::blitBegin(getGLTypes());
-        GLMeta::blitSource(source.getGLTypes());
-        GLMeta::blitRectangle(sourceRect, destRect);
-        GLMeta::blitEnd();
+        const IntRect &entry = source.p->atlasSlot.rect;
+        IntRect srcRect(sourceRect.x + entry.x, sourceRect.y + entry.y,
+                        sourceRect.w, sourceRect.h);
+        
+        p->blitTexture(shState->spriteAtlas().page(source.p->atlasSlot), srcRect, destRect, opacity);
     }
     else
     {
-        /* Fragment pipeline */
-        float normOpacity = (float) opacity / 255.0f;
-        
-        TEXFBO &gpTex = shState->gpTexFBO(destRect.w, destRect.h);
-        
-        GLMeta::blitBegin(gpTex);
-        GLMeta::blitSource(getGLTypes());
-        GLMeta::blitRectangle(destRect, Vec2i());
-        GLMeta::blitEnd();
-        
-        FloatRect bltSubRect((float) sourceRect.x / source.width(),
-                             (float) sourceRect.y / source.height(),
-                             ((float) source.width() / sourceRect.w) * ((float) destRect.w / gpTex.width),
-                             ((float) source.height() / sourceRect.h) * ((float) destRect.h / gpTex.height));
-        
-        BltShader &shader = shState->shaders().blt;
-        shader.bind();
-        shader.setDestination(gpTex.tex);
-        shader.setSubRect(bltSubRect);
-        shader.setOpacity(normOpacity);
-        
-        Quad &quad = shState->gpQuad();
-        quad.setTexPosRect(sourceRect, destRect);
-        quad.setColor(Vec4(1, 1, 1, normOpacity));
-        
-        source.p->bindTexture(shader);
-        p->bindFBO();
-        p->pushSetViewport(shader);
-        
-        p->blitQuad(quad);
-        
-        p->popViewport();
+        p->blitTexture(source.getGLTypes(), sourceRect, destRect, opacity);
     }
     
     p->addTaintedArea(destRect);
@@ -994,7 +1849,8 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
     GUARD_MEGA;
     GUARD_ANIMATED;
     
-    p->fillRect(rect, color);
+    p->prepareWrite(true);
+    p->deferFill(rect, color);
     
     if (color.w == 0)
     /* Clear op */
@@ -1023,35 +1879,8 @@ void Bitmap::gradientFillRect(const IntRect &rect,
     GUARD_MEGA;
     GUARD_ANIMATED;
     
-    SimpleColorShader &shader = shState->shaders().simpleColor;
-    shader.bind();
-    shader.setTranslation(Vec2i());
-    
-    Quad &quad = shState->gpQuad();
-    
-    if (vertical)
-    {
-        quad.vert[0].color = color1;
-        quad.vert[1].color = color1;
-        quad.vert[2].color = color2;
-        quad.vert[3].color = color2;
-    }
-    else
-    {
-        quad.vert[0].color = color1;
-        quad.vert[3].color = color1;
-        quad.vert[1].color = color2;
-        quad.vert[2].color = color2;
-    }
-    
-    quad.setPosRect(rect);
-    
-    p->bindFBO();
-    p->pushSetViewport(shader);
-    
-    p->blitQuad(quad);
-    
-    p->popViewport();
+    p->prepareWrite(true);
+    p->deferGradientFill(rect, color1, color2, vertical);
     
     p->addTaintedArea(rect);
     
@@ -1070,7 +1899,8 @@ void Bitmap::clearRect(const IntRect &rect)
     GUARD_MEGA;
     GUARD_ANIMATED;
     
-    p->fillRect(rect, Vec4());
+    p->prepareWrite(true);
+    p->deferFill(rect, Vec4());
     
     p->onModified();
 }
@@ -1082,6 +1912,8 @@ void Bitmap::blur()
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->prepareWrite();
+    
     Quad &quad = shState->gpQuad();
     FloatRect rect(0, 0, width(), height());
     quad.setTexPosRect(rect, rect);
@@ -1117,97 +1949,119 @@ void Bitmap::blur()
     p->onModified();
 }
 
-void Bitmap::radialBlur(int angle, int divisions)
+static void dualBlurPass(ShaderBase &shader, TEXFBO &src, TEXFBO &dst)
 {
-    guardDisposed();
-    
-    GUARD_MEGA;
-    GUARD_ANIMATED;
-    
-    angle     = clamp<int>(angle, 0, 359);
-    divisions = clamp<int>(divisions, 2, 100);
-    
-    const int _width = width();
-    const int _height = height();
+    Quad &quad = shState->gpQuad();
+    quad.setTexPosRect(FloatRect(0, 0, src.width, src.height),
+                       FloatRect(0, 0, dst.width, dst.height));
     
-    float angleStep = (float) angle / (divisions-1);
-    float opacity   = 1.0f / divisions;
-    float baseAngle = -((float) angle / 2);
+    glState.viewport.set(IntRect(0, 0, dst.width, dst.height));
+    shader.applyViewportProj();
+    shader.setTexSize(Vec2i(src.width, src.height));
     
-    ColorQuadArray qArray;
-    qArray.resize(5);
+    TEX::bind(src.tex);
+    TEX::setSmooth(true);
+    FBO::bind(dst.fbo);
     
-    std::vector<Vertex> &vert = qArray.vertices;
+    quad.draw();
+}
+
+void Bitmap::blur(int radius)
+{
+    guardDisposed();
     
-    int i = 0;
+    GUARD_MEGA;
+    GUARD_ANIMATED;
     
-    /* Center */
-    FloatRect texRect(0, 0, _width, _height);
-    FloatRect posRect(0, 0, _width, _height);
+    if (radius <= 0)
+        return;
     
-    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    p->prepareWrite();
     
-    /* Upper */
-    posRect = FloatRect(0, 0, _width, -_height);
+    /* Each level of the pyramid halves the resolution, so
+     * levels are added until the per-pass sample offset is
+     * down to about two texels; spreading the samples any
+     * further apart leaves ghosted copies instead of a blur.
+     * The smallest level is kept at least two pixels wide */
+    int levels = 1;
     
-    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    while (levels < BLUR_MAX_LEVELS &&
+           radius > (2 << levels) &&
+           std::min(width(), height()) >> (levels + 1) >= 2)
+        ++levels;
     
-    /* Lower */
-    posRect = FloatRect(0, _height*2, _width, -_height);
+    float offset = std::min((float) radius / (1 << levels), 3.0f);
     
-    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    TexPool &pool = shState->texPool();
+    TEXFBO chain[BLUR_MAX_LEVELS + 1];
+    chain[0] = p->gl;
     
-    /* Left */
-    posRect = FloatRect(0, 0, -_width, _height);
+    for (int i = 1; i <= levels; ++i)
+        chain[i] = pool.request(std::max(width() >> i, 1),
+                                std::max(height() >> i, 1));
     
-    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    DualBlurShader &shader = shState->shaders().dualBlur;
     
-    /* Right */
-    posRect = FloatRect(_width*2, 0, -_width, _height);
+    glState.blend.pushSet(false);
+    glState.viewport.pushSet(IntRect(0, 0, width(), height()));
     
-    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    shader.down.bind();
+    shader.down.setOffset(offset);
     
-    for (int i = 0; i < 4*5; ++i)
-        vert[i].color = Vec4(1, 1, 1, opacity);
+    for (int i = 0; i < levels; ++i)
+        dualBlurPass(shader.down, chain[i], chain[i+1]);
     
-    qArray.commit();
+    shader.up.bind();
+    shader.up.setOffset(offset);
     
-    FBO::bind(p->frontBuffer.fbo);
+    for (int i = levels; i > 0; --i)
+        dualBlurPass(shader.up, chain[i], chain[i-1]);
     
-    glState.clearColor.pushSet(Vec4());
-    FBO::clear();
+    glState.viewport.pop();
+    glState.blend.pop();
     
-    Transform trans;
-    trans.setOrigin(Vec2(_width / 2.0f, _height / 2.0f));
-    trans.setPosition(Vec2(_width / 2.0f, _height / 2.0f));
+    for (int i = 0; i <= levels; ++i)
+    {
+        TEX::bind(chain[i].tex);
+        TEX::setSmooth(false);
+    }
     
-    glState.blendMode.pushSet(BlendAddition);
+    for (int i = 1; i <= levels; ++i)
+        pool.release(chain[i]);
     
-    SimpleMatrixShader &shader = shState->shaders().simpleMatrix;
-    shader.bind();
+    p->onModified();
+}
+
+void Bitmap::radialBlur(int angle, int divisions)
+{
+    guardDisposed();
     
-    p->bindTexture(shader);
-    TEX::setSmooth(true);
+    GUARD_MEGA;
+    GUARD_ANIMATED;
     
-    p->pushSetViewport(shader);
+    angle     = clamp<int>(angle, 0, 359);
+    divisions = clamp<int>(divisions, 2, 100);
     
-    for (int i = 0; i < divisions; ++i)
-    {
-        trans.setRotation(baseAngle + i*angleStep);
-        shader.setMatrix(trans.getMatrix());
-        qArray.draw();
-    }
+    float angleStep = (float) angle / (divisions-1);
+    float baseAngle = -((float) angle / 2);
     
-    p->popViewport();
+    p->sampleBlur(baseAngle * M_PI / 180, angleStep * M_PI / 180, 0, divisions);
+}
+
+void Bitmap::zoomBlur(int zoom, int divisions)
+{
+    guardDisposed();
     
-    TEX::setSmooth(false);
+    GUARD_MEGA;
+    GUARD_ANIMATED;
     
-    glState.blendMode.pop();
-    glState.clearColor.pop();
+    zoom      = clamp<int>(zoom, 0, 100);
+    divisions = clamp<int>(divisions, 2, 100);
     
-    std::swap(p->gl, p->frontBuffer);
+    /* The last sample is scaled up by 'zoom' percent */
+    float zoomStep = (zoom / 100.0f) / (divisions-1);
     
-    p->onModified();
+    p->sampleBlur(0, 0, zoomStep, divisions);
 }
 
 void Bitmap::shade(CustomShader *shader) {
@@ -1215,6 +2069,8 @@ void Bitmap::shade(CustomShader *shader) {
 
 	GUARD_MEGA;
 
+	p->prepareWrite();
+
 	Quad &quad = shState->gpQuad();
 	FloatRect rect(0, 0, width(), height());
 	quad.setTexPosRect(rect, rect);
@@ -1248,6 +2104,10 @@ void Bitmap::clear()
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    /* Everything still queued would be cleared anyway */
+    p->prepareWrite(true);
+    p->dropDeferred();
+    
     p->bindFBO();
     
     glState.clearColor.pushSet(Vec4());
@@ -1279,18 +2139,7 @@ Color Bitmap::getPixel(int x, int y) const
     if (x < 0 || y < 0 || x >= width() || y >= height())
         return Vec4();
     
-    if (!p->surface)
-    {
-        p->allocSurface();
-        
-        FBO::bind(p->gl.fbo);
-        
-        glState.viewport.pushSet(IntRect(0, 0, width(), height()));
-        
-        gl.ReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, p->surface->pixels);
-        
-        glState.viewport.pop();
-    }
+    p->readSurface();
     
     uint32_t pixel = getPixelAt(p->surface, p->format, x, y);
     
@@ -1315,6 +2164,8 @@ void Bitmap::setPixel(int x, int y, const Color &color)
         (uint8_t) clamp<double>(color.alpha, 0, 255)
     };
     
+    p->prepareWrite();
+    
     TEX::bind(p->gl.tex);
     TEX::uploadSubImage(x, y, 1, 1, &pixel, GL_RGBA);
     
@@ -1332,15 +2183,66 @@ void Bitmap::setPixel(int x, int y, const Color &color)
     p->onModified(false);
 }
 
+void *Bitmap::mapPixels()
+{
+    guardDisposed();
+    
+    GUARD_MEGA;
+    GUARD_ANIMATED;
+    
+    p->readSurface();
+    p->mappedPixels++;
+    
+    return p->surface->pixels;
+}
+
+void Bitmap::unmapPixels(int y, int rows)
+{
+    guardDisposed();
+    
+    if (p->mappedPixels == 0)
+        return;
+    
+    int w = width();
+    
+    y = clamp(y, 0, height());
+    rows = clamp(rows, 0, height() - y);
+    
+    if (rows > 0)
+    {
+        p->prepareWrite();
+        
+        uint8_t *pixels = static_cast<uint8_t*>(p->surface->pixels);
+        
+        TEX::bind(p->gl.tex);
+        TEX::uploadSubImage(0, y, w, rows, pixels + y * p->surface->pitch, GL_RGBA);
+        
+        p->addTaintedArea(IntRect(0, y, w, rows));
+        p->onModified(false);
+    }
+    
+    if (--p->mappedPixels == 0 && p->surfaceStale)
+    {
+        /* Drawn to while mapped; the copy is out of date */
+        SDL_FreeSurface(p->surface);
+        p->surface = 0;
+        p->surfaceStale = false;
+    }
+}
+
 bool Bitmap::getRaw(void *output, int output_size)
 {
     if (output_size != width()*height()*4) return false;
     
     guardDisposed();
     
-    if (!p->animation.enabled && (p->surface || p->megaSurface)) {
-        void *src = (p->megaSurface) ? p->megaSurface->pixels : p->surface->pixels;
-        memcpy(output, src, output_size);
+    p->flushDeferred();
+    
+    if (p->isMega()) {
+        p->readMegaTiles((uint8_t*)output);
+    }
+    else if (!p->animation.enabled && p->surface) {
+        memcpy(output, p->surface->pixels, output_size);
     }
     else {
         FBO::bind(getGLTypes().fbo);
@@ -1362,6 +2264,8 @@ void Bitmap::replaceRaw(void *pixel_data, int size)
     if (size != w*h*4)
         throw Exception(Exception::MKXPError, "Replacement bitmap data is not large enough (given %i bytes, need %i)", size, requiredsize);
     
+    p->prepareWrite();
+    
     TEX::bind(getGLTypes().tex);
     TEX::uploadImage(w, h, pixel_data, GL_RGBA);
     
@@ -1373,10 +2277,12 @@ void Bitmap::saveToFile(const char *filename)
 {
     guardDisposed();
     
+    p->flushDeferred();
+    
     SDL_Surface *surf;
     
-    if (p->surface || p->megaSurface) {
-        surf = (p->surface) ? p->surface : p->megaSurface;
+    if (p->surface) {
+        surf = p->surface;
     }
     else {
         surf = SDL_CreateRGBSurface(0, width(), height(),p->format->BitsPerPixel, p->format->Rmask,p->format->Gmask,p->format->Bmask,p->format->Amask);
@@ -1387,42 +2293,54 @@ void Bitmap::saveToFile(const char *filename)
         getRaw(surf->pixels, surf->w * surf->h * 4);
     }
     
-    // Try and determine the intended image format from the filename extension
-    const char *period = strrchr(filename, '.');
-    int filetype = 0;
-    if (period) {
-        period++;
-        std::string ext;
-        for (int i = 0; i < (int)strlen(period); i++) {
-            ext += tolower(period[i]);
-        }
+    std::string fn_normalized = shState->fileSystem().normalize(filename, 1, 1);
+    
+    try {
+        ImageSaver::encode(surf, fn_normalized);
+    } catch (const Exception &) {
+        if (!p->surface)
+            SDL_FreeSurface(surf);
         
-        if (!ext.compare("png")) {
-            filetype = 1;
-        }
-        else if (!ext.compare("jpg") || !ext.compare("jpeg")) {
-            filetype = 2;
-        }
+        throw;
     }
     
+    if (!p->surface)
+        SDL_FreeSurface(surf);
+}
+
+int Bitmap::saveToFileAsync(const char *filename)
+{
+    guardDisposed();
+    
+    p->flushDeferred();
+    
     std::string fn_normalized = shState->fileSystem().normalize(filename, 1, 1);
-    int rc;
-    switch (filetype) {
-        case 2:
-            rc = IMG_SaveJPG(surf, fn_normalized.c_str(), 90);
-            break;
-        case 1:
-            rc = IMG_SavePNG(surf, fn_normalized.c_str());
-            break;
-        case 0: default:
-            rc = SDL_SaveBMP(surf, fn_normalized.c_str());
-            break;
+    
+    /* Pixels that are already on the CPU only need encoding */
+    if (p->surface) {
+        SDL_Surface *surf = SDL_ConvertSurface(p->surface, p->surface->format, 0);
+        
+        if (!surf)
+            throw Exception(Exception::SDLError, "Failed to prepare bitmap for saving: %s", SDL_GetError());
+        
+        return shState->imageSaver().save(surf, fn_normalized);
     }
     
-    if (!p->surface && !p->megaSurface)
-        SDL_FreeSurface(surf);
+    /* Mega tiles don't fit a single readback */
+    if (p->isMega()) {
+        SDL_Surface *surf = SDL_CreateRGBSurface(0, width(), height(), p->format->BitsPerPixel,
+                                                 p->format->Rmask, p->format->Gmask,
+                                                 p->format->Bmask, p->format->Amask);
+        
+        if (!surf)
+            throw Exception(Exception::SDLError, "Failed to prepare bitmap for saving: %s", SDL_GetError());
+        
+        p->readMegaTiles((uint8_t*)surf->pixels);
+        
+        return shState->imageSaver().save(surf, fn_normalized);
+    }
     
-    if (rc) throw Exception(Exception::SDLError, "%s", SDL_GetError());
+    return shState->imageSaver().save(getGLTypes(), width(), height(), fn_normalized);
 }
 
 void Bitmap::hueChange(int hue)
@@ -1435,6 +2353,8 @@ void Bitmap::hueChange(int hue)
     if ((hue % 360) == 0)
         return;
     
+    p->prepareWrite();
+    
     FloatRect texRect(rect());
     
     Quad &quad = shState->gpQuad();
@@ -1663,6 +2583,10 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
     
     FloatRect posRect(alignX, alignY, txtSurf->w * squeeze, txtSurf->h);
     
+    /* Text only touches its own rect, so fills and icon
+     * blits queued elsewhere can keep batching around it */
+    p->prepareWrite(IntRect(alignX, alignY, ceilf(posRect.w), posRect.h));
+    
     Vec2i gpTexSize;
     shState->ensureTexSize(txtSurf->w, txtSurf->h, gpTexSize);
     
@@ -1872,17 +2796,32 @@ void Bitmap::setInitFont(Font *value)
 }
 
 TEXFBO &Bitmap::getGLTypes() const
+{
+    p->flushDeferred();
+    
+    return p->getGLTypes();
+}
+
+void Bitmap::flushDeferred() const
+{
+    p->flushDeferred();
+}
+
+TEXFBO &Bitmap::getGLTypesUnflushed() const
 {
     return p->getGLTypes();
 }
 
 TEXFBO &Bitmap::frontBuffer() const
 {
+    p->ensureScratch();
+    
     return p->frontBuffer;
 }
 
 void Bitmap::pingpongBind()
 {
+    p->ensureScratch();
     p->pingpongBind();
 }
 
@@ -1891,9 +2830,27 @@ SDL_Surface *Bitmap::surface() const
     return p->surface;
 }
 
-SDL_Surface *Bitmap::megaSurface() const
+TEXFBO &Bitmap::megaTile(int i) const
+{
+    return p->megaTiles[i];
+}
+
+int Bitmap::megaTileCount() const
 {
-    return p->megaSurface;
+    return (int)p->megaTiles.size();
+}
+
+IntRect Bitmap::megaTileRect(int i) const
+{
+    return p->megaTileRect(i);
+}
+
+void Bitmap::bindMegaTile(int i, ShaderBase &shader) const
+{
+    TEXFBO &tile = p->megaTiles[i];
+    
+    TEX::bind(tile.tex);
+    shader.setTexSize(Vec2i(tile.width, tile.height));
 }
 
 void Bitmap::ensureNonMega() const
@@ -1994,15 +2951,28 @@ int Bitmap::addFrame(Bitmap &source, int position)
     source.guardDisposed();
     
     GUARD_MEGA;
+    GUARD_MAPPED;
     
     if (source.height() != height() || source.width() != width())
         throw Exception(Exception::MKXPError, "Animations with varying dimensions are not supported (%ix%i vs %ix%i)",
                         source.width(), source.height(), width(), height());
     
-    TEXFBO newframe = shState->texPool().request(source.width(), source.height());
+    p->prepareWrite();
+    source.p->flushDeferred();
+    
+    FrameStrip &frames = p->animation.frames;
     
     // Convert the bitmap into an animated bitmap if it isn't already one
     if (!p->animation.enabled) {
+        frames.setup(p->gl.width, p->gl.height);
+        
+        int cell = frames.insert(-1);
+        
+        GLMeta::blitBegin(frames.page(cell));
+        GLMeta::blitSource(p->gl);
+        GLMeta::blitRectangle(rect(), frames.cellRect(cell).pos());
+        GLMeta::blitEnd();
+        
         p->animation.width = p->gl.width;
         p->animation.height = p->gl.height;
         p->animation.enabled = true;
@@ -2013,38 +2983,32 @@ int Bitmap::addFrame(Bitmap &source, int position)
         if (p->animation.fps <= 0)
             p->animation.fps = shState->graphics().getFrameRate();
         
-        p->animation.frames.push_back(p->gl);
+        shState->texPool().release(p->gl);
         
         if (p->surface)
             SDL_FreeSurface(p->surface);
+        p->surface = 0;
         p->gl = TEXFBO();
     }
     
+    int cell = frames.insert((position < 0) ? -1 : clamp(position, 0, (int)frames.size()));
+    IntRect cellRect = frames.cellRect(cell);
+    
     if (source.surface()) {
-        TEX::bind(newframe.tex);
-        TEX::uploadImage(source.width(), source.height(), source.surface()->pixels, GL_RGBA);
-        SDL_FreeSurface(p->surface);
-        p->surface = 0;
+        TEX::bind(frames.page(cell).tex);
+        TEX::uploadSubImage(cellRect.x, cellRect.y, cellRect.w, cellRect.h,
+                            source.surface()->pixels, GL_RGBA);
     }
     else {
-        GLMeta::blitBegin(newframe);
+        GLMeta::blitBegin(frames.page(cell));
         GLMeta::blitSource(source.getGLTypes());
-        GLMeta::blitRectangle(rect(), rect(), true);
+        GLMeta::blitRectangle(rect(), cellRect.pos());
         GLMeta::blitEnd();
     }
     
-    int ret;
-    
-    if (position < 0) {
-        p->animation.frames.push_back(newframe);
-        ret = (int)p->animation.frames.size();
-    }
-    else {
-        p->animation.frames.insert(p->animation.frames.begin() + clamp(position, 0, (int)p->animation.frames.size()), newframe);
-        ret = position;
-    }
+    p->invalidateFrameView();
     
-    return ret;
+    return (position < 0) ? (int)frames.size() : position;
 }
 
 void Bitmap::removeFrame(int position) {
@@ -2052,12 +3016,25 @@ void Bitmap::removeFrame(int position) {
     
     GUARD_UNANIMATED;
     
-    int pos = (position < 0) ? (int)p->animation.frames.size() - 1 : clamp(position, 0, (int)(p->animation.frames.size() - 1));
-    shState->texPool().release(p->animation.frames[pos]);
-    p->animation.frames.erase(p->animation.frames.begin() + pos);
+    FrameStrip &frames = p->animation.frames;
+    
+    int pos = (position < 0) ? (int)frames.size() - 1 : clamp(position, 0, (int)(frames.size() - 1));
+    frames.erase(pos);
+    p->invalidateFrameView();
     
     // Change the animated bitmap back to a normal one if there's only one frame left
-    if (p->animation.frames.size() == 1) {
+    if (frames.size() == 1) {
+        int cell = frames.cells[0];
+        
+        p->gl = shState->texPool().request(frames.width, frames.height);
+        
+        GLMeta::blitBegin(p->gl);
+        GLMeta::blitSource(frames.page(cell));
+        GLMeta::blitRectangle(frames.cellRect(cell), Vec2i());
+        GLMeta::blitEnd();
+        
+        frames.clear();
+        p->releaseFrameView();
         
         p->animation.enabled = false;
         p->animation.playing = false;
@@ -2065,9 +3042,6 @@ void Bitmap::removeFrame(int position) {
         p->animation.height = 0;
         p->animation.lastFrame = 0;
         
-        p->gl = p->animation.frames[0];
-        p->animation.frames.erase(p->animation.frames.begin());
-        
         FBO::bind(p->gl.fbo);
         taintArea(rect());
     }
@@ -2120,11 +3094,6 @@ void Bitmap::setAnimationFPS(float FPS)
     if (restart) p->animation.play();
 }
 
-std::vector<TEXFBO> &Bitmap::getFrames() const
-{
-    return p->animation.frames;
-}
-
 float Bitmap::getAnimationFPS() const
 {
     guardDisposed();
@@ -2152,9 +3121,24 @@ bool Bitmap::getLooping() const
     return p->animation.loop;
 }
 
-void Bitmap::bindTex(ShaderBase &shader)
+void Bitmap::bindTex(ShaderBase &shader, bool isolated) const
 {
-    p->bindTexture(shader);
+    p->flushDeferred();
+    p->bindTexture(shader, isolated);
+}
+
+TEXFBO &Bitmap::sampleSource(Vec2i &offset) const
+{
+    p->flushDeferred();
+    
+    return p->sampleSource(offset);
+}
+
+void Bitmap::flush()
+{
+    guardDisposed();
+    
+    p->flushDeferred();
 }
 
 void Bitmap::taintArea(const IntRect &rect)
@@ -2184,17 +3168,44 @@ bool Bitmap::invalid() const {
     return p == 0;
 }
 
+void Bitmap::dispose()
+{
+    /* Scripts can't pull the pixels out from under a
+     * with_pixels block; everything else releases anyway */
+    if (!isDisposed())
+        GUARD_MAPPED;
+    
+    Disposable::dispose();
+}
+
 void Bitmap::releaseResources()
 {
-    if (p->megaSurface)
-        SDL_FreeSurface(p->megaSurface);
+    /* Reached from the destructor and Graphics.reset,
+     * so whatever is still mapped is let go of here */
+    p->mappedPixels = 0;
+    
+    if (p->surface)
+        SDL_FreeSurface(p->surface);
+    
+    /* Anything still blitting from us needs our pixels now */
+    if (!deferredBitmaps.empty())
+        p->flushReaders();
+    
+    if (p->isMega()) {
+        p->releaseMegaTiles();
+    }
     else if (p->animation.enabled) {
         p->animation.enabled = false;
         p->animation.playing = false;
-        for (TEXFBO &tex : p->animation.frames)
-            shState->texPool().release(tex);
+        p->animation.frames.clear();
+        p->releaseFrameView();
     }
-    else {
+    else if (p->inAtlas()) {
+        shState->spriteAtlas().remove(p->atlasSlot);
+        shState->texPool().release(p->frontBuffer);
+        shState->texPool().release(p->backBuffer);
+    }
+    else if (p->unshareTextures()) {
         shState->texPool().release(p->gl);
         shState->texPool().release(p->frontBuffer);
         shState->texPool().release(p->backBuffer);
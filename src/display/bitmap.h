@@ -81,18 +81,41 @@ public:
 	void clearRect(const IntRect &rect);
 
 	void blur();
+
+	/* Dual filter blur; each doubling of the radius adds
+	 * one more (quarter-sized) level to the pyramid */
+	void blur(int radius);
 	void radialBlur(int angle, int divisions);
+	void zoomBlur(int zoom, int divisions);
 	
 	void shade(CustomShader* shader);
 
 	void clear();
 
+	/* Fills, gradients and plain copies are queued and drawn
+	 * in batches; this draws whatever is still pending */
+	void flush();
+
 	Color getPixel(int x, int y) const;
 	void setPixel(int x, int y, const Color &color);
     
     bool getRaw(void *output, int output_size);
     void replaceRaw(void *pixel_data, int size);
+    
+    /* Exposes the cached client copy of the pixels (same layout
+     * as getRaw) for direct access. Rows that were changed are
+     * uploaded by unmapPixels; anything drawn to the bitmap in
+     * the meantime is overwritten by them */
+    void *mapPixels();
+    void unmapPixels(int y, int rows);
+    
+    /* Raises while the pixels are mapped */
+    void dispose();
     void saveToFile(const char *filename);
+    
+    /* Returns a ticket for ImageSaver::status(); the file is
+     * encoded and written in the background */
+    int saveToFileAsync(const char *filename);
 
 	void hueChange(int hue);
 
@@ -120,10 +143,22 @@ public:
 
 	/* <internal> */
 	TEXFBO &getGLTypes() const;
+
+	/* getGLTypes() draws queued operations first, which rebinds
+	 * the framebuffer and shader. Between GLMeta::blitBegin and
+	 * blitEnd, flush beforehand and use the unflushed variant */
+	void flushDeferred() const;
+	TEXFBO &getGLTypesUnflushed() const;
 	TEXFBO &frontBuffer() const;
 	void pingpongBind();
     SDL_Surface *surface() const;
-	SDL_Surface *megaSurface() const;
+
+	/* Mega bitmaps are kept on the GPU only, split into a grid
+	 * of textures ("tiles"); this is what they're drawn from */
+	int megaTileCount() const;
+	IntRect megaTileRect(int i) const;
+	TEXFBO &megaTile(int i) const;
+	void bindMegaTile(int i, ShaderBase &shader) const;
 	void ensureNonMega() const;
     void ensureNonAnimated() const;
     void ensureAnimated() const;
@@ -142,7 +177,6 @@ public:
     
     void nextFrame();
     void previousFrame();
-    std::vector<TEXFBO> &getFrames() const;
     
     void setAnimationFPS(float FPS);
     float getAnimationFPS() const;
@@ -154,8 +188,17 @@ public:
     // ----------
     
 	/* Binds the backing texture and sets the correct
-	 * texture size uniform in shader */
-	void bindTex(ShaderBase &shader);
+	 * texture size uniform in shader. Animated bitmaps bind
+	 * their frame strip and select the current frame through
+	 * the shader's frame offset; pass 'isolated' to get a
+	 * texture holding only the frame instead (eg. for
+	 * wrapping samplers or frame-relative coordinates) */
+	void bindTex(ShaderBase &shader, bool isolated = false) const;
+
+	/* The texture currently holding the content, which may be
+	 * shared with other bitmaps or frames; 'offset' receives
+	 * the content's position inside of it */
+	TEXFBO &sampleSource(Vec2i &offset) const;
 
 	/* Adds 'rect' to tainted area */
 	void taintArea(const IntRect &rect);
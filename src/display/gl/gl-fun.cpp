@@ -97,6 +97,7 @@ void initGLFunctions()
     
     /* Assume single digit */
     int glMajor = *ver - '0';
+    int glMinor = (ver[1] == '.') ? ver[2] - '0' : 0;
     
     if (glMajor < 2)
 #ifndef GLES2_HEADER
@@ -157,6 +158,52 @@ void initGLFunctions()
         throw EXC("No FBO support available");
     }
     
+    /* Buffer mapping entrypoints */
+    if (glMajor >= 3 || HAVE_EXT(ARB_map_buffer_range))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_PBO_FUN;
+    }
+    
+    /* Sync object entrypoints */
+    if (glMajor > 3 || (glMajor == 3 && (gles || glMinor >= 2)) || HAVE_EXT(ARB_sync))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_SYNC_FUN;
+    }
+    
+    /* Program binary entrypoints */
+    if ((gles && glMajor >= 3) || glMajor > 4 || (glMajor == 4 && glMinor >= 1) ||
+        HAVE_EXT(ARB_get_program_binary))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_PROGRAM_BINARY_FUN;
+        GL_PROGRAM_PARAM_FUN;
+    }
+    else if (HAVE_EXT(OES_get_program_binary))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "OES"
+        GL_PROGRAM_BINARY_FUN;
+    }
+    
+    /* Parallel shader compile entrypoints */
+    if (HAVE_EXT(KHR_parallel_shader_compile))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "KHR"
+        GL_PARALLEL_COMPILE_FUN;
+    }
+    else if (HAVE_EXT(ARB_parallel_shader_compile))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "ARB"
+        GL_PARALLEL_COMPILE_FUN;
+    }
+    
     /* VAO entrypoints */
     if (HAVE_EXT(ARB_vertex_array_object) || glMajor >= 3)
     {
@@ -204,4 +251,17 @@ void initGLFunctions()
     
     if (!gles || glMajor >= 3 || HAVE_EXT(OES_texture_npot))
         gl.npot_repeat = true;
+    
+    /* GLES 2 has no pixel pack buffers */
+    if ((!gles || glMajor >= 3) && gl.MapBufferRange && gl.FenceSync)
+        gl.async_readback = true;
+    
+    /* Drivers may expose the entrypoints without
+     * supporting a single binary format */
+    if (gl.GetProgramBinary && gl.ProgramBinary)
+    {
+        GLint formats = 0;
+        gl.GetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        gl.program_binary = (formats > 0);
+    }
 }
@@ -0,0 +1,347 @@
+/*
+** imagesaver.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagesaver.h"
+#include "readbackring.h"
+#include "exception.h"
+#include "sdl-util.h"
+#include "profiler.h"
+
+#include <SDL_image.h>
+#include <SDL_surface.h>
+#include <SDL_mutex.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <string.h>
+#include <ctype.h>
+
+/* Readbacks the GPU may be behind on before
+ * another save has to wait for the oldest */
+#define READBACK_SLOTS 4
+
+struct Readback
+{
+	int ticket;
+	int handle;
+	std::string path;
+};
+
+struct SaveJob
+{
+	int ticket;
+	SDL_Surface *surf;
+	std::string path;
+};
+
+struct SaveResult
+{
+	ImageSaver::Status status;
+	std::string error;
+};
+
+struct ImageSaverPrivate
+{
+	/* Only touched from the GL thread */
+	ReadbackRing ring;
+	std::deque<Readback> readbacks;
+	std::vector<uint8_t> pixels;
+	int ticketCounter;
+
+	/* Shared with the worker, guarded by 'mutex' */
+	std::deque<SaveJob> jobs;
+	std::map<int, SaveResult> results;
+	int busy;
+	bool quit;
+
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	SDL_Thread *thread;
+
+	ImageSaverPrivate()
+	    : ring(READBACK_SLOTS),
+	      ticketCounter(0),
+	      busy(0),
+	      quit(false)
+	{
+		mutex = SDL_CreateMutex();
+		cond = SDL_CreateCond();
+		thread = createSDLThread
+			<ImageSaverPrivate, &ImageSaverPrivate::worker>(this, "imagesaver");
+	}
+
+	~ImageSaverPrivate()
+	{
+		SDL_LockMutex(mutex);
+		quit = true;
+		SDL_CondBroadcast(cond);
+		SDL_UnlockMutex(mutex);
+
+		SDL_WaitThread(thread, 0);
+
+		for (size_t i = 0; i < jobs.size(); ++i)
+			SDL_FreeSurface(jobs[i].surf);
+
+		SDL_DestroyCond(cond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	int newTicket()
+	{
+		int ticket = ++ticketCounter;
+
+		SaveResult res;
+		res.status = ImageSaver::Pending;
+
+		SDL_LockMutex(mutex);
+		results[ticket] = res;
+		SDL_UnlockMutex(mutex);
+
+		return ticket;
+	}
+
+	void enqueue(int ticket, SDL_Surface *surf, const std::string &path)
+	{
+		SaveJob job;
+		job.ticket = ticket;
+		job.surf = surf;
+		job.path = path;
+
+		SDL_LockMutex(mutex);
+		jobs.push_back(job);
+		SDL_CondSignal(cond);
+		SDL_UnlockMutex(mutex);
+	}
+
+	/* Takes the pixels of a finished readback out
+	 * of the ring and hands them to the worker */
+	void complete(const Readback &rb)
+	{
+		int width, height;
+		ring.fetch(rb.handle, pixels, width, height);
+
+		SDL_Surface *surf =
+			SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ABGR8888);
+
+		if (surf)
+		{
+			memcpy(surf->pixels, &pixels[0], pixels.size());
+			enqueue(rb.ticket, surf, rb.path);
+
+			return;
+		}
+
+		SaveResult res;
+		res.status = ImageSaver::Failed;
+		res.error = SDL_GetError();
+
+		SDL_LockMutex(mutex);
+		results[rb.ticket] = res;
+		SDL_CondBroadcast(cond);
+		SDL_UnlockMutex(mutex);
+	}
+
+	/* Readbacks complete in submission order */
+	void collect()
+	{
+		ring.poll();
+
+		while (!readbacks.empty())
+		{
+			const Readback &rb = readbacks.front();
+
+			if (ring.status(rb.handle) != ReadbackRing::Done)
+				break;
+
+			complete(rb);
+			readbacks.pop_front();
+		}
+	}
+
+	void worker()
+	{
+		PROFILE_THREAD("Image saver");
+
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (jobs.empty() && !quit)
+				SDL_CondWait(cond, mutex);
+
+			if (jobs.empty())
+				break;
+
+			SaveJob job = jobs.front();
+			jobs.pop_front();
+			++busy;
+
+			SDL_UnlockMutex(mutex);
+
+			SaveResult res;
+			res.status = ImageSaver::Done;
+
+			try
+			{
+				PROFILE_ZONE("ImageSaver::encode");
+				ImageSaver::encode(job.surf, job.path);
+			}
+			catch (const Exception &e)
+			{
+				res.status = ImageSaver::Failed;
+				res.error = e.msg.c_str();
+			}
+
+			SDL_FreeSurface(job.surf);
+
+			SDL_LockMutex(mutex);
+			results[job.ticket] = res;
+			--busy;
+			SDL_CondBroadcast(cond);
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+ImageSaver::ImageSaver()
+{
+	p = new ImageSaverPrivate();
+}
+
+ImageSaver::~ImageSaver()
+{
+	finish();
+
+	delete p;
+}
+
+int ImageSaver::save(const TEXFBO &obj, int width, int height, const std::string &path)
+{
+	int ticket = p->newTicket();
+
+	p->collect();
+
+	/* Rather than have the ring drop its oldest result */
+	if (p->ring.full())
+	{
+		p->ring.wait(p->readbacks.front().handle);
+		p->collect();
+	}
+
+	Readback rb;
+	rb.ticket = ticket;
+	rb.handle = p->ring.read(obj, width, height);
+	rb.path = path;
+
+	p->readbacks.push_back(rb);
+
+	/* Without pixel pack buffers the readback already
+	 * stalled; encoding still happens off-thread */
+	if (!gl.async_readback)
+		p->collect();
+
+	return ticket;
+}
+
+int ImageSaver::save(SDL_Surface *surf, const std::string &path)
+{
+	int ticket = p->newTicket();
+	p->enqueue(ticket, surf, path);
+
+	return ticket;
+}
+
+void ImageSaver::poll()
+{
+	p->collect();
+}
+
+ImageSaver::Status ImageSaver::status(int ticket, std::string *error)
+{
+	Status status = Unknown;
+
+	SDL_LockMutex(p->mutex);
+
+	std::map<int, SaveResult>::iterator iter = p->results.find(ticket);
+
+	if (iter != p->results.end())
+	{
+		status = iter->second.status;
+
+		if (error)
+			*error = iter->second.error;
+
+		if (status != Pending)
+			p->results.erase(iter);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+
+	return status;
+}
+
+void ImageSaver::finish()
+{
+	p->ring.finish();
+	p->collect();
+
+	SDL_LockMutex(p->mutex);
+
+	while (!p->jobs.empty() || p->busy > 0)
+		SDL_CondWait(p->cond, p->mutex);
+
+	SDL_UnlockMutex(p->mutex);
+}
+
+void ImageSaver::encode(SDL_Surface *surf, const std::string &path)
+{
+	// Try and determine the intended image format from the filename extension
+	size_t period = path.rfind('.');
+	int filetype = 0;
+	if (period != std::string::npos) {
+		std::string ext;
+		for (size_t i = period + 1; i < path.size(); i++) {
+			ext += tolower(path[i]);
+		}
+
+		if (!ext.compare("png")) {
+			filetype = 1;
+		}
+		else if (!ext.compare("jpg") || !ext.compare("jpeg")) {
+			filetype = 2;
+		}
+	}
+
+	int rc;
+	switch (filetype) {
+		case 2:
+			rc = IMG_SaveJPG(surf, path.c_str(), 90);
+			break;
+		case 1:
+			rc = IMG_SavePNG(surf, path.c_str());
+			break;
+		case 0: default:
+			rc = SDL_SaveBMP(surf, path.c_str());
+			break;
+	}
+
+	if (rc) throw Exception(Exception::SDLError, "%s", SDL_GetError());
+}
@@ -0,0 +1,76 @@
+/*
+** imagesaver.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGESAVER_H
+#define IMAGESAVER_H
+
+#include "gl-util.h"
+
+#include <string>
+
+struct SDL_Surface;
+struct ImageSaverPrivate;
+
+/* Saves images to disk without stalling the RGSS thread.
+ * Pixels are read back through a ReadbackRing; once the
+ * GPU is done, encoding and writing happen on a worker
+ * thread. Beyond a few readbacks in flight, saving waits
+ * on the oldest one. Every save is identified by
+ * a ticket which can be polled for its status */
+class ImageSaver
+{
+public:
+	enum Status
+	{
+		Unknown,
+		Pending,
+		Done,
+		Failed
+	};
+
+	ImageSaver();
+	~ImageSaver();
+
+	/* Issues a readback of the (width x height) area of 'obj' */
+	int save(const TEXFBO &obj, int width, int height, const std::string &path);
+
+	/* Takes ownership of 'surf' */
+	int save(SDL_Surface *surf, const std::string &path);
+
+	/* Hands finished readbacks over to the worker.
+	 * Called once per frame */
+	void poll();
+
+	/* Finished tickets are forgotten once queried; on
+	 * failure, 'error' receives the reason */
+	Status status(int ticket, std::string *error = 0);
+
+	/* Blocks until all pending saves have been written */
+	void finish();
+
+	/* Encodes 'surf' according to the extension of 'path'
+	 * (PNG, JPG, otherwise BMP) and writes it out. Throws
+	 * on failure */
+	static void encode(SDL_Surface *surf, const std::string &path);
+
+private:
+	ImageSaverPrivate *p;
+};
+
+#endif // IMAGESAVER_H
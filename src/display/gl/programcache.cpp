@@ -0,0 +1,215 @@
+/*
+** programcache.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "programcache.h"
+#include "config.h"
+#include "filesystem/filesystem.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Bump whenever the file layout or the way
+ * keys are computed changes */
+#define FORMAT_VER 1
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+static const char cacheMagic[4] = { 'M', 'K', 'P', 'B' };
+
+struct FileHeader
+{
+	char magic[4];
+	uint32_t formatVer;
+	uint64_t driver;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t length;
+};
+
+static bool enabled = false;
+static std::string cacheDir;
+static uint64_t driverHash;
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static uint64_t hashGLString(uint64_t hash, GLenum name)
+{
+	const char *str = (const char*) gl.GetString(name);
+
+	if (str)
+		hash = hashBytes(hash, str, strlen(str) + 1);
+
+	return hash;
+}
+
+static std::string entryPath(const ProgramCache::Key &key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) key.hash);
+
+	return cacheDir + name;
+}
+
+ProgramCache::Key::Key()
+    : hash(FNV_OFFSET)
+{
+	const uint32_t ver = FORMAT_VER;
+	add(&ver, sizeof(ver));
+}
+
+void ProgramCache::Key::add(const void *data, size_t size)
+{
+	/* Hash the size too, so that moving bytes
+	 * between parts yields a different key */
+	const uint64_t size64 = size;
+	hash = hashBytes(hash, &size64, sizeof(size64));
+	hash = hashBytes(hash, data, size);
+}
+
+void ProgramCache::Key::add(const char *str)
+{
+	add(str, strlen(str));
+}
+
+void ProgramCache::init(const Config &conf)
+{
+	enabled = false;
+
+	if (!conf.shaderCache || !gl.program_binary || conf.customDataPath.empty())
+		return;
+
+	cacheDir = conf.customDataPath + "/shadercache";
+
+	if (!mkxp_fs::createDirectory(cacheDir.c_str()))
+		return;
+
+	driverHash = FNV_OFFSET;
+	driverHash = hashGLString(driverHash, GL_VENDOR);
+	driverHash = hashGLString(driverHash, GL_RENDERER);
+	driverHash = hashGLString(driverHash, GL_VERSION);
+	driverHash = hashGLString(driverHash, GL_SHADING_LANGUAGE_VERSION);
+
+	enabled = true;
+}
+
+void ProgramCache::prepare(GLuint program)
+{
+	if (enabled && gl.ProgramParameteri)
+		gl.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ProgramCache::load(GLuint program, const Key &key)
+{
+	if (!enabled)
+		return false;
+
+	std::string path = entryPath(key);
+	FILE *f = fopen(path.c_str(), "rb");
+
+	if (!f)
+		return false;
+
+	FileHeader hd;
+	std::vector<char> binary;
+	bool valid = false;
+
+	if (fread(&hd, sizeof(hd), 1, f) == 1 &&
+	    !memcmp(hd.magic, cacheMagic, sizeof(cacheMagic)) &&
+	    hd.formatVer == FORMAT_VER && hd.driver == driverHash &&
+	    hd.key == key.hash && hd.length > 0)
+	{
+		binary.resize(hd.length);
+		valid = (fread(&binary[0], 1, hd.length, f) == hd.length);
+	}
+
+	fclose(f);
+
+	if (valid)
+	{
+		gl.ProgramBinary(program, hd.binaryFormat, &binary[0], hd.length);
+
+		GLint success;
+		gl.GetProgramiv(program, GL_LINK_STATUS, &success);
+		valid = success;
+	}
+
+	/* Stale or rejected; it gets replaced once
+	 * the program is linked from source */
+	if (!valid)
+		remove(path.c_str());
+
+	return valid;
+}
+
+void ProgramCache::store(GLuint program, const Key &key)
+{
+	if (!enabled)
+		return;
+
+	GLint length = 0;
+	gl.GetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum binaryFormat;
+	GLsizei written = 0;
+	gl.GetProgramBinary(program, length, &written, &binaryFormat, &binary[0]);
+
+	if (written <= 0)
+		return;
+
+	FileHeader hd;
+	memcpy(hd.magic, cacheMagic, sizeof(cacheMagic));
+	hd.formatVer = FORMAT_VER;
+	hd.driver = driverHash;
+	hd.key = key.hash;
+	hd.binaryFormat = binaryFormat;
+	hd.length = written;
+
+	std::string path = entryPath(key);
+	FILE *f = fopen(path.c_str(), "wb");
+
+	if (!f)
+		return;
+
+	bool ok = fwrite(&hd, sizeof(hd), 1, f) == 1 &&
+	          fwrite(&binary[0], 1, written, f) == (size_t) written;
+
+	fclose(f);
+
+	/* Don't leave a truncated entry behind */
+	if (!ok)
+		remove(path.c_str());
+}
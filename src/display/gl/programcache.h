@@ -0,0 +1,63 @@
+/*
+** programcache.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "gl-fun.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Config;
+
+/* Keeps linked shader programs on disk as driver binaries,
+ * so later runs can skip GLSL compilation altogether.
+ * Entries are named after a hash of every source part fed
+ * into the compiler, and remember which driver produced them.
+ * A binary from another driver, or one the driver refuses to
+ * link, is deleted and the caller compiles from source */
+class ProgramCache
+{
+public:
+	struct Key
+	{
+		uint64_t hash;
+
+		Key();
+
+		void add(const void *data, size_t size);
+		void add(const char *str);
+	};
+
+	/* Needs a current GL context; the cache stays
+	 * disabled if this is never called */
+	static void init(const Config &conf);
+
+	/* Call before linking a program that will be stored */
+	static void prepare(GLuint program);
+
+	/* Returns true if 'program' was linked from a cached binary */
+	static bool load(GLuint program, const Key &key);
+
+	/* Writes out the binary of the linked 'program' */
+	static void store(GLuint program, const Key &key);
+};
+
+#endif // PROGRAMCACHE_H
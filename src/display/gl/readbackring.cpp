@@ -0,0 +1,236 @@
+/*
+** readbackring.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "readbackring.h"
+#include "debugwriter.h"
+#include "profiler.h"
+
+#include <string.h>
+
+struct ReadbackSlot
+{
+	/* 0 while the slot is free */
+	int handle;
+	ReadbackRing::Status status;
+	int width, height;
+
+	GLuint pbo;
+	size_t pboSize;
+	_GLsync fence;
+
+	std::vector<uint8_t> pixels;
+};
+
+ReadbackRing::ReadbackRing(int slotCount)
+    : slots(slotCount),
+      handleCounter(0)
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		ReadbackSlot &slot = slots[i];
+
+		slot.handle = 0;
+		slot.status = Unknown;
+		slot.width = slot.height = 0;
+		slot.pbo = 0;
+		slot.pboSize = 0;
+		slot.fence = 0;
+	}
+}
+
+ReadbackRing::~ReadbackRing()
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].fence)
+			gl.DeleteSync(slots[i].fence);
+
+		if (slots[i].pbo)
+			gl.DeleteBuffers(1, &slots[i].pbo);
+	}
+}
+
+int ReadbackRing::read(const TEXFBO &obj, int width, int height)
+{
+	/* A free slot, or else the oldest one */
+	ReadbackSlot *slot = &slots[0];
+
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].handle == 0)
+		{
+			slot = &slots[i];
+			break;
+		}
+
+		if (slots[i].handle < slot->handle)
+			slot = &slots[i];
+	}
+
+	if (slot->status == Pending)
+	{
+		Debug() << "Readback ring is full, waiting on readback" << slot->handle;
+		complete(*slot, true);
+	}
+
+	slot->handle = ++handleCounter;
+	slot->width = width;
+	slot->height = height;
+
+	const size_t size = width * height * 4;
+
+	FBO::bind(obj.fbo);
+
+	if (!gl.async_readback)
+	{
+		slot->pixels.resize(size);
+		gl.ReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &slot->pixels[0]);
+		slot->status = Done;
+
+		return slot->handle;
+	}
+
+	if (!slot->pbo)
+		gl.GenBuffers(1, &slot->pbo);
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+
+	if (slot->pboSize != size)
+	{
+		gl.BufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		slot->pboSize = size;
+	}
+
+	gl.ReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot->fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->status = Pending;
+
+	return slot->handle;
+}
+
+void ReadbackRing::poll()
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		ReadbackSlot &slot = slots[i];
+
+		if (slot.status != Pending)
+			continue;
+
+		if (gl.ClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			continue;
+
+		complete(slot, false);
+	}
+}
+
+void ReadbackRing::wait(int handle)
+{
+	ReadbackSlot *slot = find(handle);
+
+	if (slot && slot->status == Pending)
+		complete(*slot, true);
+}
+
+void ReadbackRing::finish()
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+		if (slots[i].status == Pending)
+			complete(slots[i], true);
+}
+
+bool ReadbackRing::full() const
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+		if (slots[i].handle == 0)
+			return false;
+
+	return true;
+}
+
+ReadbackRing::Status ReadbackRing::status(int handle)
+{
+	ReadbackSlot *slot = find(handle);
+
+	return slot ? slot->status : Unknown;
+}
+
+bool ReadbackRing::fetch(int handle, std::vector<uint8_t> &pixels,
+                         int &width, int &height)
+{
+	ReadbackSlot *slot = find(handle);
+
+	if (!slot || slot->status != Done)
+		return false;
+
+	pixels.swap(slot->pixels);
+	width = slot->width;
+	height = slot->height;
+
+	slot->pixels.clear();
+	slot->handle = 0;
+	slot->status = Unknown;
+
+	return true;
+}
+
+ReadbackSlot *ReadbackRing::find(int handle)
+{
+	if (handle <= 0)
+		return 0;
+
+	for (size_t i = 0; i < slots.size(); ++i)
+		if (slots[i].handle == handle)
+			return &slots[i];
+
+	return 0;
+}
+
+void ReadbackRing::complete(ReadbackSlot &slot, bool wait)
+{
+	PROFILE_ZONE("ReadbackRing::complete");
+
+	if (wait)
+		gl.ClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+
+	gl.DeleteSync(slot.fence);
+	slot.fence = 0;
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	void *data = gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.pboSize, GL_MAP_READ_BIT);
+
+	if (data)
+	{
+		slot.pixels.resize(slot.pboSize);
+		memcpy(&slot.pixels[0], data, slot.pboSize);
+		gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else
+	{
+		/* Leave black rather than lose the handle */
+		Debug() << "Failed to map pixel buffer of readback" << slot.handle;
+		slot.pixels.assign(slot.pboSize, 0);
+	}
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.status = Done;
+}
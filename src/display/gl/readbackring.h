@@ -0,0 +1,82 @@
+/*
+** readbackring.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef READBACKRING_H
+#define READBACKRING_H
+
+#include "gl-util.h"
+
+#include <stdint.h>
+#include <vector>
+
+struct ReadbackSlot;
+
+/* A fixed number of slots, each with its own pixel buffer
+ * object, that framebuffer contents are read back into
+ * without stalling. A readback is fenced and its pixels
+ * copied out on a later poll, once the GPU got to it; they
+ * then stay in the slot until fetched. When every slot is
+ * taken, the oldest one is reused and its result dropped.
+ *
+ * Without pixel pack buffers, readbacks finish immediately.
+ * Must only be used on the thread owning the GL context */
+class ReadbackRing
+{
+public:
+	enum Status
+	{
+		Unknown,
+		Pending,
+		Done
+	};
+
+	ReadbackRing(int slots);
+	~ReadbackRing();
+
+	/* Issues a readback of the (width x height) area of
+	 * 'obj' and returns the handle identifying it */
+	int read(const TEXFBO &obj, int width, int height);
+
+	/* Copies out the readbacks the GPU has finished */
+	void poll();
+
+	/* Waits for one, or every pending readback */
+	void wait(int handle);
+	void finish();
+
+	/* Whether read() would have to reuse a slot */
+	bool full() const;
+
+	Status status(int handle);
+
+	/* Moves the RGBA pixels of a finished readback into
+	 * 'pixels' and frees its slot. Returns false if it
+	 * is still pending or unknown */
+	bool fetch(int handle, std::vector<uint8_t> &pixels,
+	           int &width, int &height);
+
+private:
+	ReadbackSlot *find(int handle);
+	void complete(ReadbackSlot &slot, bool wait);
+
+	std::vector<ReadbackSlot> slots;
+	int handleCounter;
+};
+
+#endif // READBACKRING_H
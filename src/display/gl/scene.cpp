@@ -21,8 +21,17 @@
 
 #include "scene.h"
 #include "sharedstate.h"
+#include "spritebatch.h"
+
+#include <SDL_rect.h>
+
+#include <algorithm>
+#include <vector>
+
+Scene::CullStats Scene::cullStats;
 
 Scene::Scene()
+    : orderDirty(false)
 {}
 
 Scene::~Scene()
@@ -38,44 +47,66 @@ Scene::~Scene()
 
 void Scene::insert(SceneElement &element)
 {
-	IntruListLink<SceneElement> *iter;
+	SceneElement *tail = elements.tail();
 
-	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
-	{
-		SceneElement *e = iter->data;
-
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
-	}
+	if (tail && element < *tail)
+		orderDirty = true;
 
 	elements.append(element.link);
 }
 
 void Scene::insertAfter(SceneElement &element, SceneElement &after)
 {
-	IntruListLink<SceneElement> *iter;
+	/* The element usually belongs right behind 'after' */
+	elements.insertBefore(element.link, *after.link.next);
 
-	for (iter = &after.link; iter != elements.end(); iter = iter->next)
-	{
-		SceneElement *e = iter->data;
+	reinsert(element);
+}
 
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
+void Scene::reinsert(SceneElement &element)
+{
+	if (!element.link.next)
+	{
+		insert(element);
+		return;
 	}
 
-	elements.append(element.link);
+	/* Elements tend to move little (eg. a character walking
+	 * by one tile), so often they remain between their
+	 * neighbors and nothing has to be done */
+	IntruListLink<SceneElement> *prev = element.link.prev;
+	IntruListLink<SceneElement> *next = element.link.next;
+
+	if (prev != elements.end() && !(*prev->data < element))
+		orderDirty = true;
+
+	if (next != elements.end() && !(element < *next->data))
+		orderDirty = true;
 }
 
-void Scene::reinsert(SceneElement &element)
+void Scene::sortElements()
 {
-	elements.remove(element.link);
-	insert(element);
+	if (!orderDirty)
+		return;
+
+	std::vector<SceneElement*> sorted;
+	sorted.reserve(elements.getSize());
+
+	IntruListLink<SceneElement> *iter;
+
+	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
+		sorted.push_back(iter->data);
+
+	std::stable_sort(sorted.begin(), sorted.end(),
+	                 [](const SceneElement *a, const SceneElement *b) { return *a < *b; });
+
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		elements.remove(sorted[i]->link);
+		elements.append(sorted[i]->link);
+	}
+
+	orderDirty = false;
 }
 
 void Scene::notifyGeometryChange()
@@ -90,15 +121,57 @@ void Scene::notifyGeometryChange()
 
 void Scene::composite()
 {
+	sortElements();
+
 	IntruListLink<SceneElement> *iter;
+	SpriteBatch &batch = shState->spriteBatch();
+
+	/* Nothing outside the scene's rect makes it through
+	 * the scissor or viewport */
+	const SDL_Rect clip = { geometry.rect.x, geometry.rect.y,
+	                        geometry.rect.w, geometry.rect.h };
 
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
 
-		if (e->visible)
-			e->draw();
+		if (!e->visible)
+			continue;
+
+		IntRect b;
+
+		if (e->bounds(b))
+		{
+			const SDL_Rect r = { b.x, b.y, b.w, b.h };
+
+			if (!SDL_HasIntersection(&r, &clip))
+			{
+				++cullStats.culled;
+				continue;
+			}
+		}
+
+		++cullStats.drawn;
+
+		if (e->batchDraw(batch))
+			continue;
+
+		batch.flush();
+		e->draw();
 	}
+
+	batch.flush();
+}
+
+bool Scene::containsCustomShaders()
+{
+	IntruListLink<SceneElement> *iter;
+
+	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
+		if (iter->data->visible && iter->data->hasCustomShaders())
+			return true;
+
+	return false;
 }
 
 
@@ -32,6 +32,7 @@ class SceneElement;
 class Viewport;
 class WindowVX;
 class Window;
+class SpriteBatch;
 struct ScanRow;
 struct TilemapPrivate;
 
@@ -52,6 +53,19 @@ public:
 		}
 	};
 
+	/* Elements that were drawn, and those skipped for lying
+	 * entirely outside their scene */
+	struct CullStats
+	{
+		int drawn;
+		int culled;
+
+		CullStats()
+		    : drawn(0),
+		      culled(0)
+		{}
+	};
+
 	Scene();
 	virtual ~Scene();
 
@@ -63,17 +77,33 @@ public:
 
 	const Geometry &getGeometry() const { return geometry; }
 
+	/* Whether any visible element draws through custom
+	 * shaders. Reads Ruby arrays, so needs the GVL */
+	bool containsCustomShaders();
+
+	/* Accumulated across all scenes; reset by the screen
+	 * at the start of each frame */
+	static CullStats cullStats;
+
 protected:
+	/* Elements are kept in draw order lazily: these only
+	 * place the element and note whether the order broke,
+	 * which is then repaired once by 'sortElements()' */
 	void insert(SceneElement &element);
 	void insertAfter(SceneElement &element, SceneElement &after);
 	void reinsert(SceneElement &element);
 
+	/* Restores draw order if anything moved out of place */
+	void sortElements();
+
 	/* Notify all elements that geometry has changed */
 	void notifyGeometryChange();
 
 	IntruList<SceneElement> elements;
 	Geometry geometry;
 
+	bool orderDirty;
+
 	friend class SceneElement;
 	friend class Window;
 	friend class WindowVX;
@@ -114,6 +144,22 @@ protected:
 	 */
 	virtual void draw() = 0;
 
+	/* Elements that can be expressed as a plain textured quad
+	 * may queue themselves in 'batch' instead of drawing, and
+	 * return true. Since only consecutive elements are merged,
+	 * the drawing order is unaffected. Returning false makes
+	 * the scene flush the batch and call 'draw()' */
+	virtual bool batchDraw(SpriteBatch &) { return false; }
+
+	/* Conservative area the element may draw to, in the same
+	 * space as its scene's geometry rect. Elements outside of
+	 * it are skipped. Returning false opts out of culling */
+	virtual bool bounds(IntRect &) { return false; }
+
+	/* Whether 'draw()' runs custom shaders, which are
+	 * Ruby objects. Only asked with the GVL held */
+	virtual bool hasCustomShaders() { return false; }
+
 	// FIXME: This should be a signal
 	virtual void onGeometryChange(const Scene::Geometry &) {}
 
@@ -22,11 +22,15 @@
 #include "shader.h"
 #include "sharedstate.h"
 #include "glstate.h"
+#include "programcache.h"
 #include "exception.h"
+#include "debugwriter.h"
 
 #include <assert.h>
 #include <string.h>
 #include <iostream>
+#include <map>
+#include <set>
 
 #ifndef MKXPZ_BUILD_XCODE
 #include "common.h.xxd"
@@ -45,36 +49,135 @@
 #include "tilemap.frag.xxd"
 #include "flashMap.frag.xxd"
 #include "lanczos3.frag.xxd"
+#include "spriteBatch.frag.xxd"
 #include "minimal.vert.xxd"
 #include "simple.vert.xxd"
 #include "simpleColor.vert.xxd"
 #include "sprite.vert.xxd"
+#include "spriteBatch.vert.xxd"
 #include "tilemap.vert.xxd"
 #include "blur.frag.xxd"
 #include "simpleMatrix.vert.xxd"
 #include "blurH.vert.xxd"
 #include "blurV.vert.xxd"
+#include "dualBlurDown.frag.xxd"
+#include "dualBlurUp.frag.xxd"
+#include "radialBlur.frag.xxd"
 #include "tilemapvx.vert.xxd"
 #endif
 
+/* Every built-in program as (id, vertex, fragment, name). Both
+ * the shader constructors and ShaderSet::warm() take their
+ * source pairings from here */
+#define BUILTIN_PROGRAMS(X) \
+	X(FlatColor,    minimal,      flatColor,      FlatColorShader) \
+	X(Simple,       simple,       simple,         SimpleShader) \
+	X(SimpleColor,  simpleColor,  simpleColor,    SimpleColorShader) \
+	X(SimpleAlpha,  simpleColor,  simpleAlpha,    SimpleAlphaShader) \
+	X(SimpleSprite, sprite,       simple,         SimpleSpriteShader) \
+	X(AlphaSprite,  sprite,       simpleAlphaUni, AlphaSpriteShader) \
+	X(Sprite,       sprite,       sprite,         SpriteShader) \
+	X(SpriteBatch,  spriteBatch,  spriteBatch,    SpriteBatchShader) \
+	X(Plane,        simple,       plane,          PlaneShader) \
+	X(Gray,         simple,       gray,           GrayShader) \
+	X(Tilemap,      tilemap,      tilemap,        TilemapShader) \
+	X(FlashMap,     simpleColor,  flashMap,       FlashMapShader) \
+	X(Trans,        simple,       trans,          TransShader) \
+	X(SimpleTrans,  simple,       transSimple,    SimpleTransShader) \
+	X(Hue,          simple,       hue,            HueShader) \
+	X(Blt,          simple,       bitmapBlit,     BltShader) \
+	X(SimpleMatrix, simpleMatrix, simpleAlpha,    SimpleMatrixShader) \
+	X(BlurH,        blurH,        blur,           BlurShader::HPass) \
+	X(BlurV,        blurV,        blur,           BlurShader::VPass) \
+	X(DualBlurDown, simple,       dualBlurDown,   DualBlurShader::Down) \
+	X(DualBlurUp,   simple,       dualBlurUp,     DualBlurShader::Up) \
+	X(RadialBlur,   simple,       radialBlur,     RadialBlurShader) \
+	X(TilemapVX,    tilemapvx,    simple,         TilemapVXShader) \
+	X(Lanczos3,     simple,       lanczos3,       Lanczos3Shader)
+
+enum BuiltinProgram
+{
+#define PROGRAM_ENUM(id, vert, frag, name) PROGRAM_##id,
+	BUILTIN_PROGRAMS(PROGRAM_ENUM)
+#undef PROGRAM_ENUM
+
+	PROGRAM_COUNT
+};
+
+struct ProgramSources
+{
+#ifndef MKXPZ_BUILD_XCODE
+	const unsigned char *vert;
+	const unsigned int *vertSize;
+	const unsigned char *frag;
+	const unsigned int *fragSize;
+#endif
+	const char *vertName;
+	const char *fragName;
+	const char *name;
+};
+
+#ifdef MKXPZ_BUILD_XCODE
+#define PROGRAM_SOURCES(id, vert, frag, name) \
+	{ #vert, #frag, #name },
+#else
+#define PROGRAM_SOURCES(id, vert, frag, name) \
+	{ ___shader_##vert##_vert, &___shader_##vert##_vert_len, \
+	  ___shader_##frag##_frag, &___shader_##frag##_frag_len, \
+	  #vert, #frag, #name },
+#endif
+
+static const ProgramSources builtinPrograms[PROGRAM_COUNT] =
+{
+	BUILTIN_PROGRAMS(PROGRAM_SOURCES)
+};
+
+#undef PROGRAM_SOURCES
+
 #ifdef MKXPZ_BUILD_XCODE
 #include "filesystem/filesystem.h"
-#define INIT_SHADER(vert, frag, name) \
+
+static std::string assetSource(const char *name, const char *ext)
+{
+	return mkxp_fs::contentsOfAssetAsString((std::string("Shaders/") + name).c_str(), ext);
+}
+
+#define INIT_SHADER(id) \
 { \
-    std::string v = mkxp_fs::contentsOfAssetAsString("Shaders/" #vert, "vert"); \
-    std::string f = mkxp_fs::contentsOfAssetAsString("Shaders/" #frag, "frag"); \
-    Shader::init((const unsigned char*)v.c_str(), v.length(), (const unsigned char*)f.c_str(), f.length(), #vert, #frag, #name); \
+    const ProgramSources &src = builtinPrograms[PROGRAM_##id]; \
+    std::string v = assetSource(src.vertName, "vert"); \
+    std::string f = assetSource(src.fragName, "frag"); \
+    Shader::init((const unsigned char*)v.c_str(), v.length(), (const unsigned char*)f.c_str(), f.length(), src.vertName, src.fragName, src.name); \
+}
+
+static void prelinkProgram(const ProgramSources &src)
+{
+	std::string v = assetSource(src.vertName, "vert");
+	std::string f = assetSource(src.fragName, "frag");
+	Shader::prelink((const unsigned char*)v.c_str(), v.length(), (const unsigned char*)f.c_str(), f.length(), src.name);
 }
 #else
-#define INIT_SHADER(vert, frag, name) \
+#define INIT_SHADER(id) \
 { \
-	Shader::init(___shader_##vert##_vert, ___shader_##vert##_vert_len, ___shader_##frag##_frag, ___shader_##frag##_frag_len, \
-	#vert, #frag, #name); \
+	const ProgramSources &src = builtinPrograms[PROGRAM_##id]; \
+	Shader::init(src.vert, *src.vertSize, src.frag, *src.fragSize, \
+	src.vertName, src.fragName, src.name); \
+}
+
+static void prelinkProgram(const ProgramSources &src)
+{
+	Shader::prelink(src.vert, *src.vertSize, src.frag, *src.fragSize, src.name);
 }
 #endif
 
 #define GET_U(name) u_##name = gl.GetUniformLocation(program, #name)
 
+/* Uniforms at or above this location are always uploaded,
+ * their last values are not remembered */
+#define UNIFORM_SHADOW_MAX 64
+
+Shader::UniformStats Shader::uniformStats = { 0, 0 };
+
 #ifdef MKXPZ_BUILD_XCODE
     std::string Shader::shaderCommon = "";
 #endif
@@ -137,14 +240,14 @@ std::string &Shader::commonHeader() {
 }
 #endif
 
-static void setupShaderSource(GLuint shader, GLenum type,
-                              const unsigned char *body, int bodySize)
+/* Fills in the parts making up the full source of a
+ * shader; returns their count (at most 4) */
+static size_t shaderSourceParts(GLenum type, const unsigned char *body, int bodySize,
+                                const GLchar **shaderSrc, GLint *shaderSrcSize)
 {
 	static const char glesDefine[] = "#define GLSLES\n";
 	static const char fragDefine[] = "#define FRAGMENT_SHADER\n";
 
-	const GLchar *shaderSrc[4];
-	GLint shaderSrcSize[4];
 	size_t i = 0;
 
 	if (gl.glsles)
@@ -174,9 +277,91 @@ static void setupShaderSource(GLuint shader, GLenum type,
 	shaderSrcSize[i] = bodySize;
 	++i;
 
-	gl.ShaderSource(shader, i, shaderSrc, shaderSrcSize);
+	return i;
+}
+
+static void setupShaderSource(GLuint shader, GLenum type,
+                              const unsigned char *body, int bodySize)
+{
+	const GLchar *shaderSrc[4];
+	GLint shaderSrcSize[4];
+	size_t count = shaderSourceParts(type, body, bodySize, shaderSrc, shaderSrcSize);
+
+	gl.ShaderSource(shader, count, shaderSrc, shaderSrcSize);
 }
 
+static void addSourceToKey(ProgramCache::Key &key, GLenum type,
+                           const unsigned char *body, int bodySize)
+{
+	const GLchar *shaderSrc[4];
+	GLint shaderSrcSize[4];
+	size_t count = shaderSourceParts(type, body, bodySize, shaderSrc, shaderSrcSize);
+
+	for (size_t i = 0; i < count; ++i)
+		key.add(shaderSrc[i], shaderSrcSize[i]);
+}
+
+static ProgramCache::Key programKey(const unsigned char *vert, int vertSize,
+                                    const unsigned char *frag, int fragSize)
+{
+	ProgramCache::Key key;
+	key.add("builtin");
+	addSourceToKey(key, GL_VERTEX_SHADER, vert, vertSize);
+	addSourceToKey(key, GL_FRAGMENT_SHADER, frag, fragSize);
+
+	return key;
+}
+
+/* Issues everything needed to link the program without
+ * querying any status, so that drivers supporting parallel
+ * compilation can carry on in the background */
+static void buildProgram(GLuint vertShader, GLuint fragShader, GLuint program,
+                         const unsigned char *vert, int vertSize,
+                         const unsigned char *frag, int fragSize)
+{
+	setupShaderSource(vertShader, GL_VERTEX_SHADER, vert, vertSize);
+	gl.CompileShader(vertShader);
+
+	setupShaderSource(fragShader, GL_FRAGMENT_SHADER, frag, fragSize);
+	gl.CompileShader(fragShader);
+
+	gl.AttachShader(program, vertShader);
+	gl.AttachShader(program, fragShader);
+
+	gl.BindAttribLocation(program, Shader::Position, "position");
+	gl.BindAttribLocation(program, Shader::TexCoord, "texCoord");
+	gl.BindAttribLocation(program, Shader::Color, "color");
+	gl.BindAttribLocation(program, Shader::Tone, "tone");
+	gl.BindAttribLocation(program, Shader::Opacity, "opacity");
+
+	ProgramCache::prepare(program);
+	gl.LinkProgram(program);
+}
+
+/* Programs issued by prelink(), waiting to be picked
+ * up by the shader object they were built for */
+struct PrelinkedProgram
+{
+	GLuint vertShader, fragShader;
+	GLuint program;
+	bool fromCache;
+
+	/* Hash of the sources it was built from */
+	uint64_t sourceHash;
+};
+
+static void deletePrelinked(const PrelinkedProgram &pre)
+{
+	gl.DeleteProgram(pre.program);
+	gl.DeleteShader(pre.vertShader);
+	gl.DeleteShader(pre.fragShader);
+}
+
+static std::map<std::string, PrelinkedProgram> prelinked;
+
+/* Programs already taken by a shader object */
+static std::set<std::string> initialized;
+
 void Shader::init(const unsigned char *vert, int vertSize,
                   const unsigned char *frag, int fragSize,
                   const char *vertName, const char *fragName,
@@ -184,9 +369,48 @@ void Shader::init(const unsigned char *vert, int vertSize,
 {
 	GLint success;
 
-	/* Compile vertex shader */
-	setupShaderSource(vertShader, GL_VERTEX_SHADER, vert, vertSize);
-	gl.CompileShader(vertShader);
+	ProgramCache::Key key = programKey(vert, vertSize, frag, fragSize);
+
+	initialized.insert(programName);
+
+	std::map<std::string, PrelinkedProgram>::iterator iter = prelinked.find(programName);
+
+	/* Prelinked programs are found by name only; never adopt
+	 * one built from anything but what we were given */
+	if (iter != prelinked.end() && iter->second.sourceHash != key.hash)
+	{
+		Debug() << "Prelinked program" << programName << "was built from other sources, discarding it";
+
+		deletePrelinked(iter->second);
+		prelinked.erase(iter);
+		iter = prelinked.end();
+	}
+
+	if (iter != prelinked.end())
+	{
+		/* Take over the prelinked objects; querying their
+		 * status below blocks only if the driver is still busy */
+		gl.DeleteProgram(program);
+		gl.DeleteShader(vertShader);
+		gl.DeleteShader(fragShader);
+
+		vertShader = iter->second.vertShader;
+		fragShader = iter->second.fragShader;
+		program = iter->second.program;
+
+		bool fromCache = iter->second.fromCache;
+		prelinked.erase(iter);
+
+		if (fromCache)
+			return;
+	}
+	else
+	{
+		if (ProgramCache::load(program, key))
+			return;
+
+		buildProgram(vertShader, fragShader, program, vert, vertSize, frag, fragSize);
+	}
 
 	gl.GetShaderiv(vertShader, GL_COMPILE_STATUS, &success);
 
@@ -198,10 +422,6 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	                    vertName, programName);
 	}
 
-	/* Compile fragment shader */
-	setupShaderSource(fragShader, GL_FRAGMENT_SHADER, frag, fragSize);
-	gl.CompileShader(fragShader);
-
 	gl.GetShaderiv(fragShader, GL_COMPILE_STATUS, &success);
 
 	if (!success)
@@ -212,16 +432,6 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	                    fragName, programName);
 	}
 
-	/* Link shader program */
-	gl.AttachShader(program, vertShader);
-	gl.AttachShader(program, fragShader);
-
-	gl.BindAttribLocation(program, Position, "position");
-	gl.BindAttribLocation(program, TexCoord, "texCoord");
-	gl.BindAttribLocation(program, Color, "color");
-
-	gl.LinkProgram(program);
-
 	gl.GetProgramiv(program, GL_LINK_STATUS, &success);
 
 	if (!success)
@@ -231,6 +441,42 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	                    "GLSL: An error occured while linking program '%s' (vertex '%s', fragment '%s')",
 	                    programName, vertName, fragName);
 	}
+
+	ProgramCache::store(program, key);
+}
+
+void Shader::prelink(const unsigned char *vert, int vertSize,
+                     const unsigned char *frag, int fragSize,
+                     const char *programName)
+{
+	if (initialized.count(programName) || prelinked.count(programName))
+		return;
+
+	ProgramCache::Key key = programKey(vert, vertSize, frag, fragSize);
+
+	PrelinkedProgram pre;
+	pre.vertShader = gl.CreateShader(GL_VERTEX_SHADER);
+	pre.fragShader = gl.CreateShader(GL_FRAGMENT_SHADER);
+	pre.program = gl.CreateProgram();
+	pre.fromCache = ProgramCache::load(pre.program, key);
+	pre.sourceHash = key.hash;
+
+	if (!pre.fromCache)
+		buildProgram(pre.vertShader, pre.fragShader, pre.program,
+		             vert, vertSize, frag, fragSize);
+
+	prelinked[programName] = pre;
+}
+
+void Shader::dropPrelinked()
+{
+	std::map<std::string, PrelinkedProgram>::iterator iter;
+
+	for (iter = prelinked.begin(); iter != prelinked.end(); ++iter)
+		deletePrelinked(iter->second);
+
+	prelinked.clear();
+	initialized.clear();
 }
 
 void Shader::initFromFile(const char *_vertFile, const char *_fragFile,
@@ -245,14 +491,78 @@ void Shader::initFromFile(const char *_vertFile, const char *_fragFile,
 	     _vertFile, _fragFile, programName);
 }
 
+bool Shader::uniformChanged(GLint location, const void *data, size_t size)
+{
+	/* Inactive uniform, ignored by GL anyway */
+	if (location < 0)
+		return false;
+
+	assert(size <= sizeof(UniformShadow::data));
+
+	/* Drivers are free to hand out sparse locations;
+	 * don't let those blow up the shadow array */
+	if (location >= UNIFORM_SHADOW_MAX)
+	{
+		++uniformStats.issued;
+		return true;
+	}
+
+	if ((size_t) location >= uniformShadows.size())
+		uniformShadows.resize(location + 1);
+
+	UniformShadow &shadow = uniformShadows[location];
+
+	if (shadow.size == size && !memcmp(shadow.data, data, size))
+	{
+		++uniformStats.skipped;
+		return false;
+	}
+
+	shadow.size = size;
+	memcpy(shadow.data, data, size);
+
+	++uniformStats.issued;
+	return true;
+}
+
+void Shader::setFloatUniform(GLint location, float value)
+{
+	if (uniformChanged(location, &value, sizeof(value)))
+		gl.Uniform1f(location, value);
+}
+
+void Shader::setIntUniform(GLint location, int value)
+{
+	if (uniformChanged(location, &value, sizeof(value)))
+		gl.Uniform1i(location, value);
+}
+
+void Shader::setIntArrayUniform(GLint location, int count, const int *values)
+{
+	if (uniformChanged(location, values, count * sizeof(int)))
+		gl.Uniform1iv(location, count, values);
+}
+
 void Shader::setVec2Uniform(GLint location, const Vec2 &vec)
 {
-    gl.Uniform2f(location, vec.x, vec.y);
+	const GLfloat value[] = { vec.x, vec.y };
+
+	if (uniformChanged(location, value, sizeof(value)))
+		gl.Uniform2f(location, vec.x, vec.y);
 }
 
 void Shader::setVec4Uniform(GLint location, const Vec4 &vec)
 {
-	gl.Uniform4f(location, vec.x, vec.y, vec.z, vec.w);
+	const GLfloat value[] = { vec.x, vec.y, vec.z, vec.w };
+
+	if (uniformChanged(location, value, sizeof(value)))
+		gl.Uniform4f(location, vec.x, vec.y, vec.z, vec.w);
+}
+
+void Shader::setMat4Uniform(GLint location, const float value[16])
+{
+	if (uniformChanged(location, value, sizeof(float) * 16))
+		gl.UniformMatrix4fv(location, 1, GL_FALSE, value);
 }
 
 void Shader::setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture)
@@ -261,7 +571,7 @@ void Shader::setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture)
 
 	gl.ActiveTexture(texUnit);
 	gl.BindTexture(GL_TEXTURE_2D, texture.gl);
-	gl.Uniform1i(location, unitIndex);
+	setIntUniform(location, unitIndex);
 	gl.ActiveTexture(GL_TEXTURE0);
 }
 
@@ -288,6 +598,7 @@ void ShaderBase::init()
 	GET_U(texSizeInv);
 	GET_U(translation);
 	GET_U(spriteMat);
+	GET_U(frameOffset);
 
 	projMat.u_mat = gl.GetUniformLocation(program, "projMat");
 }
@@ -298,25 +609,31 @@ void ShaderBase::applyViewportProj()
 	projMat.set(Vec2i(vp.w, vp.h));
 }
 
-void ShaderBase::setTexSize(const Vec2i &value)
+void ShaderBase::setTexSize(const Vec2i &value, const Vec2i &frameOffset)
 {
-	gl.Uniform2f(u_texSizeInv, 1.f / value.x, 1.f / value.y);
+	setVec2Uniform(u_texSizeInv, Vec2(1.f / value.x, 1.f / value.y));
+	setVec2Uniform(u_frameOffset, Vec2(frameOffset.x, frameOffset.y));
+}
+
+bool ShaderBase::hasFrameOffset() const
+{
+	return u_frameOffset != -1;
 }
 
 void ShaderBase::setTranslation(const Vec2i &value)
 {
-	gl.Uniform2f(u_translation, value.x, value.y);
+	setVec2Uniform(u_translation, Vec2(value.x, value.y));
 }
 
 void ShaderBase::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setMat4Uniform(u_spriteMat, value);
 }
 
 
 FlatColorShader::FlatColorShader()
 {
-	INIT_SHADER(minimal, flatColor, FlatColorShader);
+	INIT_SHADER(FlatColor);
 
 	ShaderBase::init();
 
@@ -331,7 +648,7 @@ void FlatColorShader::setColor(const Vec4 &value)
 
 SimpleShader::SimpleShader()
 {
-	INIT_SHADER(simple, simple, SimpleShader);
+	INIT_SHADER(Simple);
 
 	ShaderBase::init();
 
@@ -340,13 +657,13 @@ SimpleShader::SimpleShader()
 
 void SimpleShader::setTexOffsetX(int value)
 {
-	gl.Uniform1f(u_texOffsetX, value);
+	setFloatUniform(u_texOffsetX, value);
 }
 
 
 SimpleColorShader::SimpleColorShader()
 {
-	INIT_SHADER(simpleColor, simpleColor, SimpleColorShader);
+	INIT_SHADER(SimpleColor);
 
 	ShaderBase::init();
 }
@@ -354,7 +671,7 @@ SimpleColorShader::SimpleColorShader()
 
 SimpleAlphaShader::SimpleAlphaShader()
 {
-	INIT_SHADER(simpleColor, simpleAlpha, SimpleAlphaShader);
+	INIT_SHADER(SimpleAlpha);
 
 	ShaderBase::init();
 }
@@ -362,7 +679,7 @@ SimpleAlphaShader::SimpleAlphaShader()
 
 SimpleSpriteShader::SimpleSpriteShader()
 {
-	INIT_SHADER(sprite, simple, SimpleSpriteShader);
+	INIT_SHADER(SimpleSprite);
 
 	ShaderBase::init();
 }
@@ -370,7 +687,7 @@ SimpleSpriteShader::SimpleSpriteShader()
 
 AlphaSpriteShader::AlphaSpriteShader()
 {
-	INIT_SHADER(sprite, simpleAlphaUni, AlphaSpriteShader);
+	INIT_SHADER(AlphaSprite);
 
 	ShaderBase::init();
 
@@ -380,13 +697,21 @@ AlphaSpriteShader::AlphaSpriteShader()
 
 void AlphaSpriteShader::setAlpha(float value)
 {
-	gl.Uniform1f(u_alpha, value);
+	setFloatUniform(u_alpha, value);
+}
+
+
+SpriteBatchShader::SpriteBatchShader()
+{
+	INIT_SHADER(SpriteBatch);
+
+	ShaderBase::init();
 }
 
 
 TransShader::TransShader()
 {
-	INIT_SHADER(simple, trans, TransShader);
+	INIT_SHADER(Trans);
 
 	ShaderBase::init();
 
@@ -414,18 +739,18 @@ void TransShader::setTransMap(TEX::ID tex)
 
 void TransShader::setProg(float value)
 {
-	gl.Uniform1f(u_prog, value);
+	setFloatUniform(u_prog, value);
 }
 
 void TransShader::setVague(float value)
 {
-	gl.Uniform1f(u_vague, value);
+	setFloatUniform(u_vague, value);
 }
 
 
 SimpleTransShader::SimpleTransShader()
 {
-	INIT_SHADER(simple, transSimple, SimpleTransShader);
+	INIT_SHADER(SimpleTrans);
 
 	ShaderBase::init();
 
@@ -446,13 +771,13 @@ void SimpleTransShader::setFrozenScene(TEX::ID tex)
 
 void SimpleTransShader::setProg(float value)
 {
-	gl.Uniform1f(u_prog, value);
+	setFloatUniform(u_prog, value);
 }
 
 
 SpriteShader::SpriteShader()
 {
-	INIT_SHADER(sprite, sprite, SpriteShader);
+	INIT_SHADER(Sprite);
 
 	ShaderBase::init();
 
@@ -485,43 +810,43 @@ void SpriteShader::setColor(const Vec4 &color)
 
 void SpriteShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 void SpriteShader::setBushDepth(float value)
 {
-	gl.Uniform1f(u_bushDepth, value);
+	setFloatUniform(u_bushDepth, value);
 }
 
 void SpriteShader::setBushOpacity(float value)
 {
-	gl.Uniform1f(u_bushOpacity, value);
+	setFloatUniform(u_bushOpacity, value);
 }
 
 void SpriteShader::setPattern(const TEX::ID pattern, const Vec2 &dimensions)
 {
     setTexUniform(u_pattern, 1, pattern);
-    gl.Uniform2f(u_patternSizeInv, 1.f / dimensions.x, 1.f / dimensions.y);
+    setVec2Uniform(u_patternSizeInv, Vec2(1.f / dimensions.x, 1.f / dimensions.y));
 }
 
 void SpriteShader::setPatternBlendType(int blendType)
 {
-    gl.Uniform1i(u_patternBlendType, blendType);
+    setIntUniform(u_patternBlendType, blendType);
 }
 
 void SpriteShader::setPatternTile(bool value)
 {
-    gl.Uniform1i(u_patternTile, value);
+    setIntUniform(u_patternTile, value);
 }
 
 void SpriteShader::setShouldRenderPattern(bool value)
 {
-    gl.Uniform1i(u_renderPattern, value);
+    setIntUniform(u_renderPattern, value);
 }
 
 void SpriteShader::setPatternOpacity(float value)
 {
-    gl.Uniform1f(u_patternOpacity, value);
+    setFloatUniform(u_patternOpacity, value);
 }
 
 void SpriteShader::setPatternScroll(const Vec2 &scroll)
@@ -536,13 +861,13 @@ void SpriteShader::setPatternZoom(const Vec2 &zoom)
 
 void SpriteShader::setInvert(bool value)
 {
-    gl.Uniform1i(u_invert, value);
+    setIntUniform(u_invert, value);
 }
 
 
 PlaneShader::PlaneShader()
 {
-	INIT_SHADER(simple, plane, PlaneShader);
+	INIT_SHADER(Plane);
 
 	ShaderBase::init();
 
@@ -569,13 +894,13 @@ void PlaneShader::setFlash(const Vec4 &flash)
 
 void PlaneShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 
 GrayShader::GrayShader()
 {
-	INIT_SHADER(simple, gray, GrayShader);
+	INIT_SHADER(Gray);
 
 	ShaderBase::init();
 
@@ -584,13 +909,13 @@ GrayShader::GrayShader()
 
 void GrayShader::setGray(float value)
 {
-	gl.Uniform1f(u_gray, value);
+	setFloatUniform(u_gray, value);
 }
 
 
 TilemapShader::TilemapShader()
 {
-	INIT_SHADER(tilemap, tilemap, TilemapShader);
+	INIT_SHADER(Tilemap);
 
 	ShaderBase::init();
 
@@ -614,24 +939,24 @@ void TilemapShader::setColor(const Vec4 &color)
 
 void TilemapShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 void TilemapShader::setAniIndex(int value)
 {
-	gl.Uniform1i(u_aniIndex, value);
+	setIntUniform(u_aniIndex, value);
 }
 
 void TilemapShader::setATFrames(int values[7])
 {
-	gl.Uniform1iv(u_atFrames, 7, values);
+	setIntArrayUniform(u_atFrames, 7, values);
 }
 
 
 
 FlashMapShader::FlashMapShader()
 {
-	INIT_SHADER(simpleColor, flashMap, FlashMapShader);
+	INIT_SHADER(FlashMap);
 
 	ShaderBase::init();
 
@@ -640,13 +965,13 @@ FlashMapShader::FlashMapShader()
 
 void FlashMapShader::setAlpha(float value)
 {
-	gl.Uniform1f(u_alpha, value);
+	setFloatUniform(u_alpha, value);
 }
 
 
 HueShader::HueShader()
 {
-	INIT_SHADER(simple, hue, HueShader);
+	INIT_SHADER(Hue);
 
 	ShaderBase::init();
 
@@ -655,13 +980,13 @@ HueShader::HueShader()
 
 void HueShader::setHueAdjust(float value)
 {
-	gl.Uniform1f(u_hueAdjust, value);
+	setFloatUniform(u_hueAdjust, value);
 }
 
 
 SimpleMatrixShader::SimpleMatrixShader()
 {
-	INIT_SHADER(simpleMatrix, simpleAlpha, SimpleMatrixShader);
+	INIT_SHADER(SimpleMatrix);
 
 	ShaderBase::init();
 
@@ -670,28 +995,86 @@ SimpleMatrixShader::SimpleMatrixShader()
 
 void SimpleMatrixShader::setMatrix(const float value[16])
 {
-	gl.UniformMatrix4fv(u_matrix, 1, GL_FALSE, value);
+	setMat4Uniform(u_matrix, value);
 }
 
 
 BlurShader::HPass::HPass()
 {
-	INIT_SHADER(blurH, blur, BlurShader::HPass);
+	INIT_SHADER(BlurH);
 
 	ShaderBase::init();
 }
 
 BlurShader::VPass::VPass()
 {
-	INIT_SHADER(blurV, blur, BlurShader::VPass);
+	INIT_SHADER(BlurV);
+
+	ShaderBase::init();
+}
+
+
+DualBlurShader::Down::Down()
+{
+	INIT_SHADER(DualBlurDown);
+
+	ShaderBase::init();
+
+	GET_U(offset);
+}
+
+void DualBlurShader::Down::setOffset(float value)
+{
+	setFloatUniform(u_offset, value);
+}
+
+DualBlurShader::Up::Up()
+{
+	INIT_SHADER(DualBlurUp);
+
+	ShaderBase::init();
+
+	GET_U(offset);
+}
+
+void DualBlurShader::Up::setOffset(float value)
+{
+	setFloatUniform(u_offset, value);
+}
+
+
+RadialBlurShader::RadialBlurShader()
+{
+	INIT_SHADER(RadialBlur);
 
 	ShaderBase::init();
+
+	GET_U(samples);
+	GET_U(baseAngle);
+	GET_U(angleStep);
+	GET_U(zoomStep);
+}
+
+void RadialBlurShader::setSamples(int value)
+{
+	setIntUniform(u_samples, value);
+}
+
+void RadialBlurShader::setAngle(float base, float step)
+{
+	setFloatUniform(u_baseAngle, base);
+	setFloatUniform(u_angleStep, step);
+}
+
+void RadialBlurShader::setZoomStep(float value)
+{
+	setFloatUniform(u_zoomStep, value);
 }
 
 
 TilemapVXShader::TilemapVXShader()
 {
-	INIT_SHADER(tilemapvx, simple, TilemapVXShader);
+	INIT_SHADER(TilemapVX);
 
 	ShaderBase::init();
 
@@ -700,13 +1083,13 @@ TilemapVXShader::TilemapVXShader()
 
 void TilemapVXShader::setAniOffset(const Vec2 &value)
 {
-	gl.Uniform2f(u_aniOffset, value.x, value.y);
+	setVec2Uniform(u_aniOffset, value);
 }
 
 
 BltShader::BltShader()
 {
-	INIT_SHADER(simple, bitmapBlit, BltShader);
+	INIT_SHADER(Blt);
 
 	ShaderBase::init();
 
@@ -718,7 +1101,7 @@ BltShader::BltShader()
 
 void BltShader::setSource()
 {
-	gl.Uniform1i(u_source, 0);
+	setIntUniform(u_source, 0);
 }
 
 void BltShader::setDestination(const TEX::ID value)
@@ -728,17 +1111,17 @@ void BltShader::setDestination(const TEX::ID value)
 
 void BltShader::setSubRect(const FloatRect &value)
 {
-	gl.Uniform4f(u_subRect, value.x, value.y, value.w, value.h);
+	setVec4Uniform(u_subRect, Vec4(value.x, value.y, value.w, value.h));
 }
 
 void BltShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 Lanczos3Shader::Lanczos3Shader()
 {
-	INIT_SHADER(simple, lanczos3, Lanczos3Shader);
+	INIT_SHADER(Lanczos3);
 
 	ShaderBase::init();
 
@@ -749,5 +1132,20 @@ Lanczos3Shader::Lanczos3Shader()
 void Lanczos3Shader::setTexSize(const Vec2i &value)
 {
 	ShaderBase::setTexSize(value);
-	gl.Uniform2f(u_sourceSize, (float)value.x, (float)value.y);
+	setVec2Uniform(u_sourceSize, Vec2((float)value.x, (float)value.y));
+}
+
+ShaderSet::~ShaderSet()
+{
+	Shader::dropPrelinked();
+}
+
+void ShaderSet::warm()
+{
+	/* Let the driver pick how many threads to compile on */
+	if (gl.MaxShaderCompilerThreads)
+		gl.MaxShaderCompilerThreads(0xFFFFFFFF);
+
+	for (int i = 0; i < PROGRAM_COUNT; ++i)
+		prelinkProgram(builtinPrograms[i]);
 }
@@ -26,21 +26,47 @@
 #include "gl-util.h"
 #include "glstate.h"
 
+#include <vector>
+#include <stdint.h>
+
 class Shader
 {
 public:
 	void bind();
 	static void unbind();
 
+	/* Uniform uploads made, and those skipped because
+	 * the program already held the value */
+	struct UniformStats
+	{
+		uint64_t issued;
+		uint64_t skipped;
+	};
+
+	static UniformStats uniformStats;
+
 	enum Attribute
 	{
 		Position = 0,
 		TexCoord = 1,
-		Color = 2
+		Color = 2,
+		Tone = 3,
+		Opacity = 4
 	};
     
     static std::string &commonHeader();
 
+	/* Issues compiling and linking the program 'programName'
+	 * ahead of the shader object using it, which picks it up
+	 * in init(). Only blocks if the driver can't compile in
+	 * the background */
+	static void prelink(const unsigned char *vert, int vertSize,
+	                    const unsigned char *frag, int fragSize,
+	                    const char *programName);
+
+	/* Frees prelinked programs nothing picked up */
+	static void dropPrelinked();
+
 protected:
 	Shader();
 	~Shader();
@@ -52,14 +78,38 @@ protected:
 	void initFromFile(const char *vertFile, const char *fragFile,
 	                  const char *programName);
 
-	static void setVec4Uniform(GLint location, const Vec4 &vec);
-    static void setVec2Uniform(GLint location, const Vec2 &vec);
-	static void setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture);
+	/* These remember the last value uploaded to each uniform
+	 * of the program, and skip uploading it again. The
+	 * program has to be bound */
+	void setFloatUniform(GLint location, float value);
+	void setIntUniform(GLint location, int value);
+	void setIntArrayUniform(GLint location, int count, const int *values);
+	void setVec2Uniform(GLint location, const Vec2 &vec);
+	void setVec4Uniform(GLint location, const Vec4 &vec);
+	void setMat4Uniform(GLint location, const float value[16]);
+	void setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture);
 
 	GLuint vertShader, fragShader;
 	GLuint program;
     
 private:
+	struct UniformShadow
+	{
+		size_t size;
+		GLfloat data[16];
+
+		UniformShadow()
+		    : size(0)
+		{}
+	};
+
+	/* Indexed by uniform location */
+	std::vector<UniformShadow> uniformShadows;
+
+	/* Updates the shadow of 'location' and returns
+	 * whether the value has to be uploaded */
+	bool uniformChanged(GLint location, const void *data, size_t size);
+
 #ifdef MKXPZ_BUILD_XCODE
     static std::string shaderCommon;
 #endif
@@ -86,14 +136,22 @@ public:
 	 * and loads it into the shaders uniform */
 	void applyViewportProj();
 
-	void setTexSize(const Vec2i &value);
+	/* 'frameOffset' is added to all texture coordinates
+	 * (in pixels) before normalization; it selects the
+	 * current frame out of an animated bitmap's frame strip */
+	void setTexSize(const Vec2i &value, const Vec2i &frameOffset = Vec2i());
+
+	/* Whether the vertex stage applies 'frameOffset', ie.
+	 * can sample from a sub-rect of a larger texture */
+	bool hasFrameOffset() const;
+
 	void setTranslation(const Vec2i &value);
 	void setSpriteMat(const float value[16]);
 
 protected:
 	void init();
 
-	GLint u_texSizeInv, u_translation, u_spriteMat;
+	GLint u_texSizeInv, u_translation, u_spriteMat, u_frameOffset;
 };
 
 class FlatColorShader : public ShaderBase
@@ -147,6 +205,14 @@ private:
 	GLint u_alpha;
 };
 
+/* Draws sprites whose effects travel with their vertices,
+ * see SpriteBatch */
+class SpriteBatchShader : public ShaderBase
+{
+public:
+	SpriteBatchShader();
+};
+
 class TransShader : public ShaderBase
 {
 public:
@@ -293,6 +359,50 @@ struct BlurShader
 	VPass pass2;
 };
 
+/* Dual filter (Kawase) blur, run as a chain of
+ * downsampling passes followed by upsampling ones */
+struct DualBlurShader
+{
+	class Down : public ShaderBase
+	{
+	public:
+		Down();
+
+		void setOffset(float value);
+
+	private:
+		GLint u_offset;
+	};
+
+	class Up : public ShaderBase
+	{
+	public:
+		Up();
+
+		void setOffset(float value);
+
+	private:
+		GLint u_offset;
+	};
+
+	Down down;
+	Up up;
+};
+
+/* Radial and zoom blur; angles are in radians */
+class RadialBlurShader : public ShaderBase
+{
+public:
+	RadialBlurShader();
+
+	void setSamples(int value);
+	void setAngle(float base, float step);
+	void setZoomStep(float value);
+
+private:
+	GLint u_samples, u_baseAngle, u_angleStep, u_zoomStep;
+};
+
 class TilemapVXShader : public ShaderBase
 {
 public:
@@ -331,28 +441,73 @@ protected:
 	GLint u_sourceSize;
 };
 
+/* Builds the wrapped shader the first time it is used */
+template<class S>
+class LazyShader
+{
+public:
+	LazyShader()
+	    : shader(0)
+	{}
+
+	~LazyShader()
+	{
+		delete shader;
+	}
+
+	S &get()
+	{
+		if (!shader)
+			shader = new S();
+
+		return *shader;
+	}
+
+	operator S&()
+	{
+		return get();
+	}
+
+private:
+	LazyShader(const LazyShader &);
+	LazyShader &operator=(const LazyShader &);
+
+	S *shader;
+};
+
 /* Global object containing all available shaders */
 struct ShaderSet
 {
-	FlatColorShader flatColor;
-	SimpleShader simple;
-	SimpleColorShader simpleColor;
-	SimpleAlphaShader simpleAlpha;
-	SimpleSpriteShader simpleSprite;
-	AlphaSpriteShader alphaSprite;
-	SpriteShader sprite;
-	PlaneShader plane;
-	GrayShader gray;
-	TilemapShader tilemap;
-	FlashMapShader flashMap;
-	TransShader trans;
-	SimpleTransShader simpleTrans;
-	HueShader hue;
-	BltShader blt;
-	SimpleMatrixShader simpleMatrix;
-	BlurShader blur;
-	TilemapVXShader tilemapVX;
-	Lanczos3Shader lanczos3;
+	~ShaderSet();
+
+	/* Starts building every shader not used yet, so that
+	 * the first use doesn't have to wait for the compiler.
+	 * With KHR_parallel_shader_compile this returns right
+	 * away, otherwise it compiles everything on the spot */
+	void warm();
+
+	LazyShader<FlatColorShader> flatColor;
+	LazyShader<SimpleShader> simple;
+	LazyShader<SimpleColorShader> simpleColor;
+	LazyShader<SimpleAlphaShader> simpleAlpha;
+	LazyShader<SimpleSpriteShader> simpleSprite;
+	LazyShader<AlphaSpriteShader> alphaSprite;
+	LazyShader<SpriteShader> sprite;
+	LazyShader<SpriteBatchShader> spriteBatch;
+	LazyShader<PlaneShader> plane;
+	LazyShader<GrayShader> gray;
+	LazyShader<TilemapShader> tilemap;
+	LazyShader<FlashMapShader> flashMap;
+	LazyShader<TransShader> trans;
+	LazyShader<SimpleTransShader> simpleTrans;
+	LazyShader<HueShader> hue;
+	LazyShader<BltShader> blt;
+	LazyShader<SimpleMatrixShader> simpleMatrix;
+	LazyShader<BlurShader> blur;
+	LazyShader<DualBlurShader> dualBlur;
+	LazyShader<RadialBlurShader> radialBlur;
+	LazyShader<TilemapVXShader> tilemapVX;
+	LazyShader<Lanczos3Shader> lanczos3;
 };
 
 #endif // SHADER_H
@@ -0,0 +1,357 @@
+/*
+** spriteatlas.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spriteatlas.h"
+#include "sharedstate.h"
+#include "texpool.h"
+#include "glstate.h"
+#include "config.h"
+
+#include <SDL_surface.h>
+
+#include <algorithm>
+#include <string.h>
+
+/* Bitmaps larger than this in either dimension
+ * are left with their own texture */
+#define MAX_ENTRY_SIZE 256
+#define MAX_PAGE_SIZE 2048
+
+/* Once this many pages exist, further bitmaps
+ * are left with their own texture too */
+#define MAX_PAGES 4
+
+/* Edge pixels repeated around each entry */
+#define BORDER 1
+
+struct AtlasSpan
+{
+	int x, width;
+};
+
+struct AtlasShelf
+{
+	int y, height;
+
+	/* Start of the free space at the end */
+	int x;
+
+	/* Space freed by removed entries before 'x', sorted
+	 * and with adjacent spans merged */
+	std::vector<AtlasSpan> gaps;
+};
+
+struct AtlasPage
+{
+	/* Zero while the page is empty */
+	TEXFBO tex;
+
+	std::vector<AtlasShelf> shelves;
+	int shelvesHeight;
+
+	int entries;
+	size_t usedArea;
+
+	AtlasPage()
+	    : shelvesHeight(0),
+	      entries(0),
+	      usedArea(0)
+	{}
+};
+
+struct SpriteAtlasPrivate
+{
+	std::vector<AtlasPage> pages;
+	int pageSize;
+	bool enabled;
+
+	/* Border-extended copy of the entry being uploaded */
+	std::vector<uint32_t> uploadBuffer;
+
+	void allocPage(AtlasPage &page)
+	{
+		page.tex = shState->texPool().request(pageSize, pageSize);
+
+		FBO::bind(page.tex.fbo);
+		glState.clearColor.pushSet(Vec4());
+		FBO::clear();
+		glState.clearColor.pop();
+	}
+
+	/* Index of the first gap of 'shelf' that fits 'width',
+	 * -1 for the end of the shelf, or -2 for neither */
+	int findSpace(const AtlasShelf &shelf, int width) const
+	{
+		for (size_t i = 0; i < shelf.gaps.size(); ++i)
+			if (shelf.gaps[i].width >= width)
+				return i;
+
+		return (shelf.x + width <= pageSize) ? -1 : -2;
+	}
+
+	/* Finds room for a (width x height) area, preferring
+	 * the shelf that wastes the least height */
+	bool place(AtlasPage &page, int width, int height, Vec2i &pos)
+	{
+		AtlasShelf *best = 0;
+		int bestGap = -1;
+
+		for (size_t i = 0; i < page.shelves.size(); ++i)
+		{
+			AtlasShelf &shelf = page.shelves[i];
+
+			if (shelf.height < height)
+				continue;
+
+			int gap = findSpace(shelf, width);
+
+			if (gap == -2)
+				continue;
+
+			if (!best || shelf.height < best->height)
+			{
+				best = &shelf;
+				bestGap = gap;
+			}
+		}
+
+		/* Don't put small entries on much taller shelves
+		 * while a fitting new one can still be opened */
+		bool canOpen = page.shelvesHeight + height <= pageSize;
+
+		if (!best || (canOpen && best->height > height * 2))
+		{
+			if (!canOpen)
+				return false;
+
+			AtlasShelf shelf;
+			shelf.y = page.shelvesHeight;
+			shelf.height = height;
+			shelf.x = 0;
+
+			page.shelves.push_back(shelf);
+			page.shelvesHeight += height;
+
+			best = &page.shelves.back();
+			bestGap = -1;
+		}
+
+		if (bestGap < 0)
+		{
+			pos = Vec2i(best->x, best->y);
+			best->x += width;
+
+			return true;
+		}
+
+		AtlasSpan &gap = best->gaps[bestGap];
+		pos = Vec2i(gap.x, best->y);
+
+		gap.x += width;
+		gap.width -= width;
+
+		if (gap.width == 0)
+			best->gaps.erase(best->gaps.begin() + bestGap);
+
+		return true;
+	}
+
+	/* Gives the (width) wide span at 'x' of the shelf at 'y'
+	 * back, dropping shelves at the bottom that end up empty */
+	void release(AtlasPage &page, int y, int x, int width)
+	{
+		size_t s = 0;
+
+		while (page.shelves[s].y != y)
+			++s;
+
+		AtlasShelf &shelf = page.shelves[s];
+		std::vector<AtlasSpan> &gaps = shelf.gaps;
+
+		size_t i = 0;
+
+		while (i < gaps.size() && gaps[i].x < x)
+			++i;
+
+		AtlasSpan span = { x, width };
+		gaps.insert(gaps.begin() + i, span);
+
+		if (i + 1 < gaps.size() && gaps[i].x + gaps[i].width == gaps[i+1].x)
+		{
+			gaps[i].width += gaps[i+1].width;
+			gaps.erase(gaps.begin() + i + 1);
+		}
+
+		if (i > 0 && gaps[i-1].x + gaps[i-1].width == gaps[i].x)
+		{
+			gaps[i-1].width += gaps[i].width;
+			gaps.erase(gaps.begin() + i);
+		}
+
+		if (!gaps.empty() && gaps.back().x + gaps.back().width == shelf.x)
+		{
+			shelf.x = gaps.back().x;
+			gaps.pop_back();
+		}
+
+		while (!page.shelves.empty() && page.shelves.back().x == 0)
+		{
+			page.shelvesHeight -= page.shelves.back().height;
+			page.shelves.pop_back();
+		}
+	}
+
+	void upload(TEXFBO &page, const Vec2i &pos, SDL_Surface *surf)
+	{
+		int w = surf->w + BORDER*2;
+		int h = surf->h + BORDER*2;
+
+		uploadBuffer.resize(w * h);
+
+		for (int y = 0; y < h; ++y)
+		{
+			int sy = clamp(y - BORDER, 0, surf->h - 1);
+			const uint32_t *src = (const uint32_t*)
+				((const uint8_t*) surf->pixels + sy * surf->pitch);
+			uint32_t *dst = &uploadBuffer[y * w];
+
+			dst[0] = src[0];
+			memcpy(dst + BORDER, src, surf->w * 4);
+			dst[w - 1] = src[surf->w - 1];
+		}
+
+		TEX::bind(page.tex);
+		TEX::uploadSubImage(pos.x, pos.y, w, h, &uploadBuffer[0], GL_RGBA);
+	}
+};
+
+SpriteAtlas::SpriteAtlas(const Config &conf)
+{
+	p = new SpriteAtlasPrivate;
+	p->enabled = conf.spriteAtlas;
+	p->pageSize = 0;
+}
+
+SpriteAtlas::~SpriteAtlas()
+{
+	for (size_t i = 0; i < p->pages.size(); ++i)
+		if (p->pages[i].tex.tex != TEX::ID(0))
+			TEXFBO::fini(p->pages[i].tex);
+
+	delete p;
+}
+
+bool SpriteAtlas::insert(SDL_Surface *surf, Slot &slot)
+{
+	if (!p->enabled)
+		return false;
+
+	if (surf->w > MAX_ENTRY_SIZE || surf->h > MAX_ENTRY_SIZE)
+		return false;
+
+	if (p->pageSize == 0)
+		p->pageSize = std::min(MAX_PAGE_SIZE, glState.caps.maxTexSize);
+
+	int w = surf->w + BORDER*2;
+	int h = surf->h + BORDER*2;
+
+	if (w > p->pageSize || h > p->pageSize)
+		return false;
+
+	Vec2i pos;
+	size_t i;
+
+	for (i = 0; i < p->pages.size(); ++i)
+		if (p->place(p->pages[i], w, h, pos))
+			break;
+
+	if (i == p->pages.size())
+	{
+		if (p->pages.size() == MAX_PAGES)
+			return false;
+
+		p->pages.push_back(AtlasPage());
+		p->place(p->pages.back(), w, h, pos);
+	}
+
+	AtlasPage &page = p->pages[i];
+
+	if (page.tex.tex == TEX::ID(0))
+		p->allocPage(page);
+
+	p->upload(page.tex, pos, surf);
+
+	page.entries++;
+	page.usedArea += surf->w * surf->h;
+
+	slot.page = i;
+	slot.rect = IntRect(pos.x + BORDER, pos.y + BORDER, surf->w, surf->h);
+
+	return true;
+}
+
+void SpriteAtlas::remove(Slot &slot)
+{
+	if (slot.page < 0)
+		return;
+
+	AtlasPage &page = p->pages[slot.page];
+
+	page.entries--;
+	page.usedArea -= slot.rect.w * slot.rect.h;
+
+	if (page.entries == 0)
+	{
+		shState->texPool().release(page.tex);
+		page = AtlasPage();
+	}
+	else
+	{
+		p->release(page, slot.rect.y - BORDER, slot.rect.x - BORDER,
+		           slot.rect.w + BORDER*2);
+	}
+
+	slot = Slot();
+}
+
+TEXFBO &SpriteAtlas::page(const Slot &slot)
+{
+	return p->pages[slot.page].tex;
+}
+
+std::vector<SpriteAtlas::PageStats> SpriteAtlas::stats() const
+{
+	std::vector<PageStats> result;
+
+	for (size_t i = 0; i < p->pages.size(); ++i)
+	{
+		const AtlasPage &page = p->pages[i];
+
+		PageStats stats;
+		stats.width = page.tex.width;
+		stats.height = page.tex.height;
+		stats.entries = page.entries;
+		stats.usedArea = page.usedArea;
+		stats.shelfArea = (size_t) page.shelvesHeight * p->pageSize;
+
+		result.push_back(stats);
+	}
+
+	return result;
+}
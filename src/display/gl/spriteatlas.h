@@ -0,0 +1,80 @@
+/*
+** spriteatlas.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEATLAS_H
+#define SPRITEATLAS_H
+
+#include "gl-util.h"
+#include "etc-internal.h"
+
+#include <vector>
+
+struct SDL_Surface;
+struct Config;
+struct SpriteAtlasPrivate;
+
+/* Packs small bitmaps loaded from disk into shared pages,
+ * so that drawing them doesn't require a texture switch
+ * each. Entries are placed on shelves, with a one pixel
+ * border of repeated edge pixels so filtering at their
+ * edges behaves like clamping. Space freed by removed
+ * entries is reused by later ones of up to its height.
+ * The number of pages is capped; past that, bitmaps keep
+ * their own texture */
+class SpriteAtlas
+{
+public:
+	struct Slot
+	{
+		int page;
+		IntRect rect;
+
+		Slot()
+		    : page(-1)
+		{}
+	};
+
+	struct PageStats
+	{
+		int width, height;
+		int entries;
+
+		/* Area covered by entries, and by shelves
+		 * (including what is lost to shelf fitting) */
+		size_t usedArea;
+		size_t shelfArea;
+	};
+
+	SpriteAtlas(const Config &conf);
+	~SpriteAtlas();
+
+	/* Uploads 'surf' into a free spot. Returns false if it
+	 * isn't eligible for atlasing or doesn't fit anywhere */
+	bool insert(SDL_Surface *surf, Slot &slot);
+	void remove(Slot &slot);
+
+	TEXFBO &page(const Slot &slot);
+
+	std::vector<PageStats> stats() const;
+
+private:
+	SpriteAtlasPrivate *p;
+};
+
+#endif // SPRITEATLAS_H
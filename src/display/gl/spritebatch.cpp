@@ -0,0 +1,172 @@
+/*
+** spritebatch.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spritebatch.h"
+#include "vertex.h"
+#include "gl-meta.h"
+#include "global-ibo.h"
+#include "sharedstate.h"
+#include "glstate.h"
+#include "shader.h"
+
+#include <vector>
+
+/* Quads the streaming buffer holds before it is orphaned */
+#define BUFFER_QUADS 4096
+
+struct SpriteBatchPrivate
+{
+	VBO::ID vbo;
+	GLMeta::VAO vao;
+
+	/* Quads written to the current buffer storage */
+	size_t bufferUsed;
+
+	std::vector<SpriteVertex> vertices;
+
+	/* What all pending sprites have in common */
+	TEX::ID tex;
+	Vec2i texSize;
+	BlendType blendType;
+
+	SpriteBatchPrivate()
+	    : bufferUsed(0),
+	      tex(TEX::ID(0)),
+	      blendType(BlendNormal)
+	{
+		vertices.reserve(BUFFER_QUADS * 4);
+
+		/* Binds the IBO, so do it before the VAO captures it */
+		shState->ensureQuadIBO(BUFFER_QUADS);
+
+		vbo = VBO::gen();
+
+		GLMeta::vaoFillInVertexData<SpriteVertex>(vao);
+		vao.vbo = vbo;
+		vao.ibo = shState->globalIBO().ibo;
+
+		GLMeta::vaoInit(vao, true);
+		VBO::allocEmpty(BUFFER_QUADS * 4 * sizeof(SpriteVertex), GL_STREAM_DRAW);
+		GLMeta::vaoUnbind(vao);
+	}
+
+	~SpriteBatchPrivate()
+	{
+		GLMeta::vaoFini(vao);
+		VBO::del(vbo);
+	}
+
+	size_t pending() const
+	{
+		return vertices.size() / 4;
+	}
+
+	void upload()
+	{
+		VBO::bind(vbo);
+
+		if (bufferUsed + pending() > BUFFER_QUADS)
+		{
+			/* Hand the old storage over to the driver instead
+			 * of overwriting what queued draws still read */
+			VBO::allocEmpty(BUFFER_QUADS * 4 * sizeof(SpriteVertex), GL_STREAM_DRAW);
+			bufferUsed = 0;
+		}
+
+		VBO::uploadSubData(bufferUsed * 4 * sizeof(SpriteVertex),
+		                   vertices.size() * sizeof(SpriteVertex),
+		                   dataPtr(vertices));
+		VBO::unbind();
+	}
+};
+
+SpriteBatch::SpriteBatch()
+{
+	p = new SpriteBatchPrivate();
+}
+
+SpriteBatch::~SpriteBatch()
+{
+	delete p;
+}
+
+void SpriteBatch::add(const TEXFBO &tex, const Vec2i &texOffset, BlendType blendType,
+                      const Vertex *vert, const float *matrix,
+                      const Vec4 &color, const Vec4 &tone, float opacity)
+{
+	if (p->pending() > 0 &&
+	    (p->tex != tex.tex || p->blendType != blendType ||
+	     p->texSize.x != tex.width || p->texSize.y != tex.height))
+		flush();
+
+	if (p->pending() == BUFFER_QUADS)
+		flush();
+
+	p->tex = tex.tex;
+	p->texSize = Vec2i(tex.width, tex.height);
+	p->blendType = blendType;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		const Vec2 &pos = vert[i].pos;
+
+		SpriteVertex v;
+		v.pos.x = matrix[0] * pos.x + matrix[4] * pos.y + matrix[12];
+		v.pos.y = matrix[1] * pos.x + matrix[5] * pos.y + matrix[13];
+		v.texPos.x = vert[i].texPos.x + texOffset.x;
+		v.texPos.y = vert[i].texPos.y + texOffset.y;
+		v.color = color;
+		v.tone = tone;
+		v.opacity = opacity;
+
+		p->vertices.push_back(v);
+	}
+}
+
+void SpriteBatch::flush()
+{
+	size_t count = p->pending();
+
+	if (count == 0)
+		return;
+
+	p->upload();
+
+	SpriteBatchShader &shader = shState->shaders().spriteBatch;
+	shader.bind();
+	shader.applyViewportProj();
+	shader.setTexSize(p->texSize);
+
+	TEX::bind(p->tex);
+	TEX::setSmooth(true);
+
+	glState.blendMode.pushSet(p->blendType);
+
+	GLMeta::vaoBind(p->vao);
+
+	const char *offset = (const char*) 0 + p->bufferUsed * 6 * sizeof(index_t);
+	gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE, offset);
+
+	GLMeta::vaoUnbind(p->vao);
+
+	glState.blendMode.pop();
+
+	p->bufferUsed += count;
+	p->vertices.clear();
+}
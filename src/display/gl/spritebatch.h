@@ -0,0 +1,57 @@
+/*
+** spritebatch.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include "gl-util.h"
+#include "etc.h"
+#include "etc-internal.h"
+
+struct Vertex;
+struct SpriteBatchPrivate;
+
+/* Merges consecutive sprites sampling the same texture with
+ * the same blend mode into a single draw call. Transforms are
+ * applied on the CPU, while color, tone and opacity travel with
+ * the vertices. Vertices are streamed into a buffer which is
+ * orphaned once it fills up, so no draw ever waits on the GPU
+ * still reading older ones */
+class SpriteBatch
+{
+public:
+	SpriteBatch();
+	~SpriteBatch();
+
+	/* Queues the quad 'vert', transformed by the column major
+	 * 'matrix'. 'texOffset' locates the sprite's content inside
+	 * 'tex'. Sprites that can't be merged with the pending ones
+	 * cause those to be drawn first */
+	void add(const TEXFBO &tex, const Vec2i &texOffset, BlendType blendType,
+	         const Vertex *vert, const float *matrix,
+	         const Vec4 &color, const Vec4 &tone, float opacity);
+
+	/* Draws all pending sprites */
+	void flush();
+
+private:
+	SpriteBatchPrivate *p;
+};
+
+#endif // SPRITEBATCH_H
@@ -23,9 +23,11 @@
 #include "exception.h"
 #include "sharedstate.h"
 #include "glstate.h"
+#include "config.h"
 #include "boost-hash.h"
 #include "debugwriter.h"
 
+#include <algorithm>
 #include <list>
 #include <utility>
 #include <assert.h>
@@ -33,67 +35,132 @@
 
 typedef std::pair<uint16_t, uint16_t> Size;
 
-static uint32_t byteCount(Size &s)
+static size_t byteCount(int width, int height)
 {
-	return s.first * s.second * 4;
+	return (size_t) width * height * 4;
 }
 
-struct CacheNode
+static int classDim(int value, TexPool::SizeClasses classes)
 {
-	TEXFBO obj;
-	std::list<TEXFBO>::iterator prioIter;
-
-	bool operator==(const CacheNode &o) const
+	switch (classes)
 	{
-		return obj == o.obj;
+	case TexPool::PowerOfTwo :
+	{
+		int result = 1;
+		while (result < value)
+			result <<= 1;
+		return result;
 	}
-};
+	case TexPool::Grid64 :
+		return (value + 63) & ~63;
+	default :
+		return value;
+	}
+}
+
+struct PoolEntry;
+typedef std::list<PoolEntry> PrioList;
+typedef std::list<PrioList::iterator> CNodeList;
+
+struct PoolEntry
+{
+	TEXFBO obj;
+	Size sizeClass;
 
-typedef std::list<CacheNode> CNodeList;
+	/* Our position in the size class bucket, so
+	 * eviction doesn't have to search for it */
+	CNodeList::iterator bucketIter;
+};
 
 struct TexPoolPrivate
 {
-	/* Contains all cached TexFBOs, grouped by size */
+	/* Contains all cached TexFBOs, grouped by size class */
 	BoostHash<Size, CNodeList> poolHash;
 
 	/* Contains all cached TexFBOs, sorted by release time */
-	std::list<TEXFBO> priorityQueue;
+	PrioList priorityQueue;
 
 	/* Maximal allowed cache memory */
-	const uint32_t maxMemSize;
+	const size_t maxMemSize;
+
+	const TexPool::SizeClasses sizeClasses;
 
 	/* Current amound of memory consumed by the cache */
-	uint32_t memSize;
+	size_t memSize;
 
 	/* Current amount of TexFBOs cached */
-	uint16_t objCount;
+	size_t objCount;
+
+	uint64_t hits;
+	uint64_t resized;
+	uint64_t misses;
+	uint64_t evictions;
 
 	/* Has this pool been disabled? */
 	bool disabled;
 
-	TexPoolPrivate(uint32_t maxMemSize)
+	TexPoolPrivate(size_t maxMemSize, TexPool::SizeClasses sizeClasses)
 	    : maxMemSize(maxMemSize),
+	      sizeClasses(sizeClasses),
 	      memSize(0),
 	      objCount(0),
+	      hits(0),
+	      resized(0),
+	      misses(0),
+	      evictions(0),
 	      disabled(false)
 	{}
+
+	Size classOf(int width, int height) const
+	{
+		return Size(classDim(width, sizeClasses), classDim(height, sizeClasses));
+	}
+
+	/* Removes a cached object from the pool in O(1) */
+	TEXFBO take(PrioList::iterator entry)
+	{
+		TEXFBO obj = entry->obj;
+
+		poolHash[entry->sizeClass].erase(entry->bucketIter);
+		priorityQueue.erase(entry);
+
+		memSize -= byteCount(obj.width, obj.height);
+		--objCount;
+
+		return obj;
+	}
 };
 
-TexPool::TexPool(uint32_t maxMemSize)
+static TexPool::SizeClasses parseSizeClasses(const std::string &value)
 {
-	p = new TexPoolPrivate(maxMemSize);
+	if (value == "pow2")
+		return TexPool::PowerOfTwo;
+
+	if (value == "64")
+		return TexPool::Grid64;
+
+	if (!value.empty() && value != "none")
+		Debug() << "TexPool: Unknown size classes" << value;
+
+	return TexPool::ExactSize;
+}
+
+TexPool::TexPool(const Config &conf)
+{
+	size_t budget = (size_t) std::max(conf.texPool.budget, 0) * 1000000;
+
+	p = new TexPoolPrivate(budget, parseSizeClasses(conf.texPool.sizeClasses));
 }
 
 TexPool::~TexPool()
 {
-	std::list<TEXFBO>::iterator iter;
+	PrioList::iterator iter;
 
 	for (iter = p->priorityQueue.begin();
 	     iter != p->priorityQueue.end();
 	     ++iter)
 	{
-		TEXFBO obj = *iter;
-		TEXFBO::fini(obj);
+		TEXFBO::fini(iter->obj);
 		--p->objCount;
 	}
 
@@ -104,42 +171,55 @@ TexPool::~TexPool()
 
 TEXFBO TexPool::request(int width, int height)
 {
-	CacheNode cnode;
-	Size size(width, height);
+	int maxSize = glState.caps.maxTexSize;
+	if (width > maxSize || height > maxSize)
+		throw Exception(Exception::MKXPError,
+		                "Texture dimensions [%d, %d] exceed hardware capabilities",
+		                width, height);
 
 	/* See if we can statisfy request from cache */
-	CNodeList &bucket = p->poolHash[size];
+	CNodeList &bucket = p->poolHash[p->classOf(width, height)];
 
 	if (!bucket.empty())
 	{
-		/* Found one! */
-		cnode = bucket.back();
-		bucket.pop_back();
-
-		p->priorityQueue.erase(cnode.prioIter);
-
-		p->memSize -= byteCount(size);
-		--p->objCount;
+		/* Found one! Prefer an exact fit, which needs no
+		 * new storage */
+		CNodeList::reverse_iterator iter;
+
+		for (iter = bucket.rbegin(); iter != bucket.rend(); ++iter)
+			if ((*iter)->obj.width == width && (*iter)->obj.height == height)
+				break;
+
+		TEXFBO obj = p->take((iter != bucket.rend()) ? *iter : bucket.back());
+
+		if (obj.width != width || obj.height != height)
+		{
+			/* Saves creating the objects, but not the
+			 * allocation, so don't count it as a hit */
+			TEXFBO::allocEmpty(obj, width, height);
+			++p->resized;
+		}
+		else
+		{
+			++p->hits;
+		}
 
 //		Debug() << "TexPool: <?+> (" << width << height << ")";
 
-		return cnode.obj;
+		return obj;
 	}
 
-	int maxSize = glState.caps.maxTexSize;
-	if (width > maxSize || height > maxSize)
-		throw Exception(Exception::MKXPError,
-		                "Texture dimensions [%d, %d] exceed hardware capabilities",
-		                width, height);
-
 	/* Nope, create it instead */
-	TEXFBO::init(cnode.obj);
-	TEXFBO::allocEmpty(cnode.obj, width, height);
-	TEXFBO::linkFBO(cnode.obj);
+	TEXFBO obj;
+	TEXFBO::init(obj);
+	TEXFBO::allocEmpty(obj, width, height);
+	TEXFBO::linkFBO(obj);
+
+	++p->misses;
 
 //	Debug() << "TexPool: <?-> (" << width << height << ")";
 
-	return cnode.obj;
+	return obj;
 }
 
 void TexPool::release(TEXFBO &obj)
@@ -158,51 +238,45 @@ void TexPool::release(TEXFBO &obj)
 		return;
 	}
 
-	Size size(obj.width, obj.height);
-
-	uint32_t newMemSize = p->memSize + byteCount(size);
+	size_t size = byteCount(obj.width, obj.height);
 
 	/* If caching this object would spill over the allowed memory budget,
 	 * delete least used objects until we're good again */
-	while (newMemSize > p->maxMemSize)
+	while (p->memSize + size > p->maxMemSize)
 	{
 		if (p->objCount == 0)
 			break;
 
 //		Debug() << "TexPool: <!~> Size:" << p->memSize;
 
-		/* Retrieve object with lowest priority for deletion */
-		CacheNode last;
-		last.obj = p->priorityQueue.back();
-		Size removedSize(last.obj.width, last.obj.height);
-
-		CNodeList &bucket = p->poolHash[removedSize];
-
-		std::list<CacheNode>::iterator toRemove =
-		        std::find(bucket.begin(), bucket.end(), last);
-		assert(toRemove != bucket.end());
-		bucket.erase(toRemove);
-
-		p->priorityQueue.pop_back();
+		/* Object with lowest priority goes first */
+		TEXFBO last = p->take(--p->priorityQueue.end());
+		TEXFBO::fini(last);
 
-		TEXFBO::fini(last.obj);
+		++p->evictions;
 
-		newMemSize -= byteCount(removedSize);
-		--p->objCount;
-
-//		Debug() << "TexPool: <!-> (" << last.obj.width << last.obj.height << ")";
+//		Debug() << "TexPool: <!-> (" << last.width << last.height << ")";
 	}
 
-	p->memSize = newMemSize;
+	/* Too big to ever fit */
+	if (p->memSize + size > p->maxMemSize)
+	{
+		TEXFBO::fini(obj);
+		return;
+	}
 
 	/* Retain object */
-	p->priorityQueue.push_front(obj);
-	CacheNode cnode;
-	cnode.obj = obj;
-	cnode.prioIter = p->priorityQueue.begin();
-	CNodeList &bucket = p->poolHash[size];
-	bucket.push_back(cnode);
+	PoolEntry entry;
+	entry.obj = obj;
+	entry.sizeClass = p->classOf(obj.width, obj.height);
+
+	p->priorityQueue.push_front(entry);
+
+	CNodeList &bucket = p->poolHash[entry.sizeClass];
+	bucket.push_back(p->priorityQueue.begin());
+	p->priorityQueue.front().bucketIter = --bucket.end();
 
+	p->memSize += size;
 	++p->objCount;
 
 //	Debug() << "TexPool: <!+> (" << obj.width << obj.height << ") Current size:" << p->memSize;
@@ -213,4 +287,15 @@ void TexPool::disable()
 	p->disabled = true;
 }
 
-
+TexPool::Stats TexPool::stats() const
+{
+	Stats stats;
+	stats.hits = p->hits;
+	stats.resized = p->resized;
+	stats.misses = p->misses;
+	stats.evictions = p->evictions;
+	stats.bytes = p->memSize;
+	stats.count = p->objCount;
+
+	return stats;
+}
@@ -24,12 +24,41 @@
 
 #include "gl-util.h"
 
+#include <stdint.h>
+#include <stddef.h>
+
+struct Config;
 struct TexPoolPrivate;
 
 class TexPool
 {
 public:
-	TexPool(uint32_t maxMemSize = 20000000 /* 20 MB */);
+	/* Released textures are grouped into size classes; a request
+	 * can be served by any cached texture of its class, whose
+	 * storage is then re-specified to the exact size */
+	enum SizeClasses
+	{
+		ExactSize,
+		PowerOfTwo,
+		Grid64
+	};
+
+	struct Stats
+	{
+		/* Cached textures reused as they were */
+		uint64_t hits;
+		/* Cached textures of the right size class whose
+		 * storage still had to be re-specified */
+		uint64_t resized;
+		uint64_t misses;
+		uint64_t evictions;
+
+		/* Currently held in the pool */
+		size_t bytes;
+		size_t count;
+	};
+
+	TexPool(const Config &conf);
 	~TexPool();
 
 	TEXFBO request(int width, int height);
@@ -37,6 +66,8 @@ public:
 
 	void disable();
 
+	Stats stats() const;
+
 private:
 	TexPoolPrivate *p;
 };
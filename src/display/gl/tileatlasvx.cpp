@@ -273,6 +273,11 @@ void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
 {
 	assert(tf.width == ATLASVX_W && tf.height == ATLASVX_H);
 
+	/* Queued drawing must not land mid-blit */
+	for (int i = 0; i < BM_COUNT; ++i)
+		if (!nullOrDisposed(bitmaps[i]))
+			bitmaps[i]->flushDeferred();
+
 	GLMeta::blitBegin(tf);
 
 	glState.clearColor.pushSet(Vec4());
@@ -292,7 +297,7 @@ void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
 #define EXEC_BLITS(part) \
 	if (!nullOrDisposed(bm = bitmaps[BM_##part])) \
 	{ \
-		GLMeta::blitSource(bm->getGLTypes()); \
+		GLMeta::blitSource(bm->getGLTypesUnflushed()); \
 		for (size_t i = 0; i < blits##part##N; ++i) \
 		{\
 			const IntRect &src = blits##part[i].src; \
@@ -32,6 +32,10 @@ Vertex::Vertex()
     : color(1, 1, 1, 1)
 {}
 
+SpriteVertex::SpriteVertex()
+    : opacity(1)
+{}
+
 #define o(type, mem) ((const GLvoid*) offsetof(type, mem))
 
 static const VertexAttribute SVertexAttribs[] =
@@ -53,6 +57,15 @@ static const VertexAttribute VertexAttribs[] =
 	{ Shader::TexCoord, 2, GL_FLOAT, o(Vertex, texPos) }
 };
 
+static const VertexAttribute SpriteVertexAttribs[] =
+{
+	{ Shader::Position, 2, GL_FLOAT, o(SpriteVertex, pos)     },
+	{ Shader::TexCoord, 2, GL_FLOAT, o(SpriteVertex, texPos)  },
+	{ Shader::Color,    4, GL_FLOAT, o(SpriteVertex, color)   },
+	{ Shader::Tone,     4, GL_FLOAT, o(SpriteVertex, tone)    },
+	{ Shader::Opacity,  1, GL_FLOAT, o(SpriteVertex, opacity) }
+};
+
 #define DEF_TRAITS(VertType) \
 	template<> \
 	const VertexAttribute *VertexTraits<VertType>::attr = VertType##Attribs; \
@@ -62,3 +75,4 @@ static const VertexAttribute VertexAttribs[] =
 DEF_TRAITS(SVertex);
 DEF_TRAITS(CVertex);
 DEF_TRAITS(Vertex);
+DEF_TRAITS(SpriteVertex);
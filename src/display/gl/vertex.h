@@ -51,6 +51,19 @@ struct Vertex
 	Vertex();
 };
 
+/* Sprite Vertex, carrying the per-sprite effects
+ * so that sprites can be drawn in batches */
+struct SpriteVertex
+{
+	Vec2 pos;
+	Vec2 texPos;
+	Vec4 color;
+	Vec4 tone;
+	float opacity;
+
+	SpriteVertex();
+};
+
 struct VertexAttribute
 {
 	Shader::Attribute index;
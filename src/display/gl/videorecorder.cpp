@@ -0,0 +1,423 @@
+/*
+** videorecorder.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "videorecorder.h"
+#include "readbackring.h"
+#include "exception.h"
+#include "debugwriter.h"
+#include "sdl-util.h"
+#include "profiler.h"
+
+#include <SDL_endian.h>
+#include <SDL_mutex.h>
+#include <SDL_rwops.h>
+
+#include <deque>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+/* Readbacks the GPU may be behind on */
+#define READBACK_SLOTS 3
+
+/* Frames waiting for the worker */
+#define MAX_QUEUED 8
+
+static const char rawMagic[4] = { 'M', 'K', 'R', 'V' };
+
+struct FrameJob
+{
+	int index;
+	std::vector<uint8_t> pixels;
+};
+
+struct PendingFrame
+{
+	int handle;
+	int index;
+};
+
+struct VideoRecorderPrivate
+{
+	VideoRecorder::Format format;
+	int width, height, frameRate;
+	SDL_RWops *ops;
+
+	/* Only touched from the GL thread */
+	ReadbackRing ring;
+	std::deque<PendingFrame> readbacks;
+	std::vector<uint8_t> discarded;
+	int frameIndex;
+	bool sizeWarned;
+
+	/* Shared with the worker, guarded by 'mutex' */
+	std::deque<FrameJob> jobs;
+	std::vector<std::vector<uint8_t> > spare;
+	int written, dropped;
+	bool quit;
+	std::string error;
+
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	SDL_Thread *thread;
+
+	/* Only touched from the worker */
+	std::vector<uint8_t> planes;
+
+	VideoRecorderPrivate(VideoRecorder::Format format,
+	                     int width, int height, int frameRate)
+	    : format(format),
+	      width(width),
+	      height(height),
+	      frameRate(frameRate),
+	      ops(0),
+	      ring(READBACK_SLOTS),
+	      frameIndex(0),
+	      sizeWarned(false),
+	      written(0),
+	      dropped(0),
+	      quit(false),
+	      thread(0)
+	{
+		mutex = SDL_CreateMutex();
+		cond = SDL_CreateCond();
+	}
+
+	~VideoRecorderPrivate()
+	{
+		stopWorker();
+
+		if (ops)
+			SDL_RWclose(ops);
+
+		SDL_DestroyCond(cond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	void stopWorker()
+	{
+		if (!thread)
+			return;
+
+		SDL_LockMutex(mutex);
+		quit = true;
+		SDL_CondBroadcast(cond);
+		SDL_UnlockMutex(mutex);
+
+		SDL_WaitThread(thread, 0);
+		thread = 0;
+	}
+
+	void drop()
+	{
+		SDL_LockMutex(mutex);
+		++dropped;
+		SDL_UnlockMutex(mutex);
+	}
+
+	/* Hands finished readbacks to the worker, in order. Unless
+	 * 'wait' is set, frames the worker has no room for are dropped */
+	void collect(bool wait)
+	{
+		ring.poll();
+
+		while (!readbacks.empty())
+		{
+			const PendingFrame &frame = readbacks.front();
+
+			if (ring.status(frame.handle) != ReadbackRing::Done)
+				break;
+
+			queue(frame, wait);
+			readbacks.pop_front();
+		}
+	}
+
+	void queue(const PendingFrame &frame, bool wait)
+	{
+		int w, h;
+
+		SDL_LockMutex(mutex);
+
+		while (wait && jobs.size() >= MAX_QUEUED && error.empty())
+			SDL_CondWait(cond, mutex);
+
+		if (jobs.size() >= MAX_QUEUED || !error.empty())
+		{
+			++dropped;
+			SDL_UnlockMutex(mutex);
+
+			/* Still has to leave the ring */
+			ring.fetch(frame.handle, discarded, w, h);
+
+			return;
+		}
+
+		/* Reuse a buffer the worker is done with */
+		std::vector<uint8_t> pixels;
+
+		if (!spare.empty())
+		{
+			pixels.swap(spare.back());
+			spare.pop_back();
+		}
+
+		SDL_UnlockMutex(mutex);
+
+		ring.fetch(frame.handle, pixels, w, h);
+
+		SDL_LockMutex(mutex);
+		jobs.push_back(FrameJob());
+		jobs.back().index = frame.index;
+		jobs.back().pixels.swap(pixels);
+		SDL_CondSignal(cond);
+		SDL_UnlockMutex(mutex);
+	}
+
+	void writeHeader()
+	{
+		if (format == VideoRecorder::Raw)
+		{
+			SDL_RWwrite(ops, rawMagic, sizeof(rawMagic), 1);
+			SDL_WriteLE32(ops, width);
+			SDL_WriteLE32(ops, height);
+			SDL_WriteLE32(ops, frameRate);
+			return;
+		}
+
+		char header[128];
+		int len = snprintf(header, sizeof(header),
+		                   "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+		                   width, height, frameRate);
+
+		SDL_RWwrite(ops, header, 1, len);
+	}
+
+	/* BT.601, studio range; chroma is averaged over 2x2 blocks */
+	void convertYUV(const uint8_t *rgba)
+	{
+		const int cw = (width + 1) / 2;
+		const int ch = (height + 1) / 2;
+
+		planes.resize(width * height + cw * ch * 2);
+
+		uint8_t *yPlane = &planes[0];
+		uint8_t *uPlane = yPlane + width * height;
+		uint8_t *vPlane = uPlane + cw * ch;
+
+		for (int i = 0; i < width * height; ++i)
+		{
+			const uint8_t *px = rgba + i * 4;
+			yPlane[i] = ((66 * px[0] + 129 * px[1] + 25 * px[2] + 128) >> 8) + 16;
+		}
+
+		for (int cy = 0; cy < ch; ++cy)
+		{
+			const int y0 = cy * 2;
+			const int y1 = (y0 + 1 < height) ? y0 + 1 : y0;
+
+			for (int cx = 0; cx < cw; ++cx)
+			{
+				const int x0 = cx * 2;
+				const int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+
+				const uint8_t *px[4] =
+				{
+					rgba + (y0 * width + x0) * 4,
+					rgba + (y0 * width + x1) * 4,
+					rgba + (y1 * width + x0) * 4,
+					rgba + (y1 * width + x1) * 4
+				};
+
+				int r = 0, g = 0, b = 0;
+
+				for (int i = 0; i < 4; ++i)
+				{
+					r += px[i][0];
+					g += px[i][1];
+					b += px[i][2];
+				}
+
+				r = (r + 2) / 4;
+				g = (g + 2) / 4;
+				b = (b + 2) / 4;
+
+				uPlane[cy * cw + cx] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+				vPlane[cy * cw + cx] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+			}
+		}
+	}
+
+	bool writeFrame(const FrameJob &job)
+	{
+		PROFILE_ZONE("VideoRecorder::writeFrame");
+
+		if (format == VideoRecorder::Raw)
+		{
+			return SDL_WriteLE32(ops, job.index) == 1 &&
+			       SDL_RWwrite(ops, &job.pixels[0], 1, job.pixels.size()) == job.pixels.size();
+		}
+
+		static const char frameHeader[] = "FRAME\n";
+
+		convertYUV(&job.pixels[0]);
+
+		return SDL_RWwrite(ops, frameHeader, 1, sizeof(frameHeader) - 1) == sizeof(frameHeader) - 1 &&
+		       SDL_RWwrite(ops, &planes[0], 1, planes.size()) == planes.size();
+	}
+
+	void worker()
+	{
+		PROFILE_THREAD("Video recorder");
+
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (jobs.empty() && !quit)
+				SDL_CondWait(cond, mutex);
+
+			if (jobs.empty())
+				break;
+
+			FrameJob job;
+			job.index = jobs.front().index;
+			job.pixels.swap(jobs.front().pixels);
+			jobs.pop_front();
+
+			const bool failed = !error.empty();
+
+			SDL_UnlockMutex(mutex);
+
+			bool ok = !failed && writeFrame(job);
+
+			SDL_LockMutex(mutex);
+
+			if (ok)
+				++written;
+			else
+				++dropped;
+
+			if (!ok && !failed)
+				error = SDL_GetError();
+
+			spare.push_back(std::vector<uint8_t>());
+			spare.back().swap(job.pixels);
+
+			SDL_CondBroadcast(cond);
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+VideoRecorder::VideoRecorder(const std::string &path, Format format,
+                             int width, int height, int frameRate)
+{
+	p = new VideoRecorderPrivate(format, width, height, frameRate);
+
+	p->ops = SDL_RWFromFile(path.c_str(), "wb");
+
+	if (!p->ops)
+	{
+		delete p;
+		throw Exception(Exception::IOError, "Failed to open %s for recording: %s",
+		                path.c_str(), SDL_GetError());
+	}
+
+	p->writeHeader();
+
+	p->thread = createSDLThread
+		<VideoRecorderPrivate, &VideoRecorderPrivate::worker>(p, "videorecorder");
+
+	Debug() << "Recording video to" << path;
+}
+
+VideoRecorder::~VideoRecorder()
+{
+	SDL_LockMutex(p->mutex);
+	p->jobs.clear();
+	SDL_UnlockMutex(p->mutex);
+
+	delete p;
+}
+
+void VideoRecorder::addFrame(const TEXFBO &obj, int width, int height)
+{
+	p->collect(false);
+
+	const int index = p->frameIndex++;
+
+	if (width != p->width || height != p->height)
+	{
+		if (!p->sizeWarned)
+			Debug() << "Screen was resized while recording; dropping frames until it's back to"
+			        << p->width << "x" << p->height;
+
+		p->sizeWarned = true;
+		p->drop();
+
+		return;
+	}
+
+	/* The GPU is behind; waiting on it is what we're avoiding */
+	if (p->ring.full())
+	{
+		p->drop();
+		return;
+	}
+
+	PendingFrame frame;
+	frame.handle = p->ring.read(obj, width, height);
+	frame.index = index;
+
+	p->readbacks.push_back(frame);
+}
+
+VideoRecorder::Stats VideoRecorder::finish()
+{
+	p->ring.finish();
+	p->collect(true);
+	p->stopWorker();
+
+	int closed = SDL_RWclose(p->ops);
+	p->ops = 0;
+
+	Stats stats = this->stats();
+
+	if (!p->error.empty())
+		throw Exception(Exception::IOError, "Failed to write video: %s", p->error.c_str());
+
+	if (closed != 0)
+		throw Exception(Exception::IOError, "Failed to write video: %s", SDL_GetError());
+
+	return stats;
+}
+
+VideoRecorder::Stats VideoRecorder::stats() const
+{
+	Stats stats;
+
+	SDL_LockMutex(p->mutex);
+	stats.written = p->written;
+	stats.dropped = p->dropped;
+	SDL_UnlockMutex(p->mutex);
+
+	return stats;
+}
@@ -0,0 +1,77 @@
+/*
+** videorecorder.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEORECORDER_H
+#define VIDEORECORDER_H
+
+#include "gl-util.h"
+
+#include <string>
+
+struct VideoRecorderPrivate;
+
+/* Streams presented frames to an uncompressed video file.
+ * Each frame costs the GL thread one asynchronous readback;
+ * color conversion and writing happen on a worker thread.
+ * Frames are dropped (and counted) rather than waited on
+ * when the GPU or the disk can't keep up.
+ *
+ * Y4M files are 4:2:0 BT.601 at the frame rate given on
+ * construction and play in most video tools. Raw files
+ * start with "MKRV", then width, height and frame rate
+ * as little endian 32 bit integers, followed by each frame
+ * as a 32 bit frame index and width * height RGBA pixels;
+ * gaps in the indices are dropped frames */
+class VideoRecorder
+{
+public:
+	enum Format
+	{
+		Y4M,
+		Raw
+	};
+
+	struct Stats
+	{
+		int written;
+		int dropped;
+	};
+
+	/* Opens 'path' and starts the worker; throws on failure */
+	VideoRecorder(const std::string &path, Format format,
+	              int width, int height, int frameRate);
+
+	/* Discards what hasn't been written yet */
+	~VideoRecorder();
+
+	/* Reads back the (width x height) area of 'obj'.
+	 * Called once per presented frame */
+	void addFrame(const TEXFBO &obj, int width, int height);
+
+	/* Writes out all outstanding frames and closes the file.
+	 * Throws if writing failed at any point */
+	Stats finish();
+
+	Stats stats() const;
+
+private:
+	VideoRecorderPrivate *p;
+};
+
+#endif // VIDEORECORDER_H
@@ -34,7 +34,10 @@
 #include "gl-fun.h"
 #include "gl-util.h"
 #include "glstate.h"
+#include "imagesaver.h"
 #include "intrulist.h"
+#include "readbackring.h"
+#include "videorecorder.h"
 #include "quad.h"
 #include "scene.h"
 #include "shader.h"
@@ -44,6 +47,7 @@
 #include "util.h"
 #include "input.h"
 #include "sprite.h"
+#include "profiler.h"
 
 #include <SDL.h>
 #include <SDL_image.h>
@@ -63,6 +67,12 @@
 #include <time.h>
 #include <cmath>
 #include <climits>
+#include <deque>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 #include "binding-types.h"
 
@@ -77,6 +87,9 @@
 #define MOVIE_AUDIO_BUFFER_SIZE 2048
 #define AUDIO_BUFFER_LEN_MS 2000
 
+/* Captures that can be in flight or waiting to be fetched */
+#define CAPTURE_SLOTS 4
+
 typedef struct AudioQueue
 {
     const THEORAPLAY_AudioPacket *audio;
@@ -504,10 +517,15 @@ public:
     }
     
     void composite() {
+        PROFILE_ZONE("ScreenScene::composite");
+        
         const int w = geometry.rect.w;
         const int h = geometry.rect.h;
         
-        shState->prepareDraw();
+        {
+            PROFILE_ZONE("prepareDraw");
+            shState->prepareDraw();
+        }
         
         pp.startRender();
         
@@ -515,6 +533,8 @@ public:
         
         FBO::clear();
         
+        cullStats = CullStats();
+        
         Scene::composite();
         
         if (brightEffect) {
@@ -528,6 +548,8 @@ public:
     }
     
     void requestViewportRender(const Vec4 &c, const Vec4 &f, const Vec4 &t, const VALUE &shaderArr) {
+        PROFILE_ZONE("Viewport effects");
+        
         const IntRect &viewpRect = glState.scissorBox.get();
         const IntRect &screenRect = geometry.rect;
         
@@ -568,7 +590,7 @@ public:
 
 		if (shaderArr)
 		{
-			long size = rb_array_len(shaderArr);
+			long size = shaderArrayLength(shaderArr);
 
 			for (long i = 0; i < size; i++)
 			{
@@ -703,6 +725,19 @@ private:
 /* Nanoseconds per second */
 #define NS_PER_S 1000000000
 
+/* How long before the deadline the pacer stops
+ * sleeping and starts yielding instead */
+#define PACER_SPIN_NS 1000000
+
+/* Waking up later than this past the deadline
+ * counts as oversleeping */
+#define PACER_OVERSLEEP_NS 250000
+
+const int Graphics::PacingStats::bucketLimitsUs[] =
+{
+    100, 250, 500, 1000, 2000, 4000, 8000
+};
+
 struct FPSLimiter {
     uint64_t lastTickCount;
     
@@ -731,6 +766,8 @@ struct FPSLimiter {
         bool resetFlag;
     } adj;
     
+    Graphics::PacingStats stats;
+    
     FPSLimiter(uint16_t desiredFPS)
     : lastTickCount(SDL_GetPerformanceCounter()),
     tickFreq(SDL_GetPerformanceFrequency()), tickFreqMS(tickFreq / 1000),
@@ -740,6 +777,15 @@ struct FPSLimiter {
         adj.last = SDL_GetPerformanceCounter();
         adj.idealDiff = 0;
         adj.resetFlag = false;
+        
+        memset(&stats, 0, sizeof(stats));
+        
+#ifdef __linux__
+        /* The default 50us timer slack makes every sleep
+         * overshoot; it is per thread, and we're constructed
+         * on the one doing the pacing */
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
     }
     
     void setDesiredFPS(uint16_t value) { tpf = tickFreq / value; }
@@ -755,10 +801,13 @@ struct FPSLimiter {
          * to the ideal timestep */
         toDelay -= adj.idealDiff;
         
-        if (toDelay < 0)
+        bool missed = (toDelay < 0);
+        
+        if (missed)
             toDelay = 0;
         
-        delayTicks(toDelay);
+        uint64_t deadline = SDL_GetPerformanceCounter() + toDelay;
+        delayUntil(deadline);
         
         uint64_t now = lastTickCount = SDL_GetPerformanceCounter();
         int64_t diff = now - adj.last;
@@ -771,7 +820,12 @@ struct FPSLimiter {
         if (adj.resetFlag) {
             adj.idealDiff = 0;
             adj.resetFlag = false;
+            
+            /* The interval spans a pause, not a frame */
+            return;
         }
+        
+        recordFrame(diff - tpf, missed, now - deadline);
     }
     
     void resetFrameAdjust() { adj.resetFlag = true; }
@@ -788,6 +842,37 @@ struct FPSLimiter {
     }
     
 private:
+    void recordFrame(int64_t deviation, bool missed, uint64_t wokeLate) {
+        ++stats.frames;
+        
+        if (missed)
+            ++stats.missed;
+        else if (wokeLate / tickFreqNS > PACER_OVERSLEEP_NS)
+            ++stats.overslept;
+        
+        double deviationUs = std::abs((double)deviation) / tickFreqNS / 1000;
+        int bucket = 0;
+        
+        while (bucket < Graphics::PacingStats::Buckets - 1 &&
+               deviationUs >= Graphics::PacingStats::bucketLimitsUs[bucket])
+            ++bucket;
+        
+        ++stats.histogram[bucket];
+    }
+    
+    /* Sleeps for most of the wait, as sleeps tend to
+     * overshoot, then yields for the remainder */
+    void delayUntil(uint64_t deadline) {
+        const uint64_t spinTicks = PACER_SPIN_NS * tickFreqNS;
+        uint64_t now = SDL_GetPerformanceCounter();
+        
+        if (now + spinTicks < deadline)
+            delayTicks(deadline - now - spinTicks);
+        
+        while (SDL_GetPerformanceCounter() < deadline)
+            std::this_thread::yield();
+    }
+    
     void delayTicks(uint64_t ticks) {
 #if defined(HAVE_NANOSLEEP)
         struct timespec req;
@@ -813,6 +898,48 @@ private:
     }
 };
 
+/* Per-frame timings. Written only by the thread finishing
+ * frames (the render thread while it is active), and read
+ * without locking; the writer publishes each entry by bumping
+ * 'written' once it is complete */
+struct FrameTimeRing {
+    /* Must be a power of two */
+    enum { Capacity = 1024 };
+    
+    /* Frames right behind the writer that readers don't look at,
+     * so that an entry can't be overwritten while being copied */
+    enum { Slack = 64 };
+    
+    struct Entry {
+        float ms[Graphics::FrameStats::PhaseCount];
+    };
+    
+    Entry entries[Capacity];
+    SDL_atomic_t written;
+    
+    FrameTimeRing() {
+        SDL_AtomicSet(&written, 0);
+    }
+    
+    void push(const Entry &entry) {
+        int index = SDL_AtomicGet(&written);
+        entries[(unsigned)index % Capacity] = entry;
+        SDL_AtomicSet(&written, index + 1);
+    }
+    
+    /* Copies out the most recent 'window' entries */
+    void snapshot(std::vector<Entry> &out, int window) const {
+        unsigned end = SDL_AtomicGet(const_cast<SDL_atomic_t*>(&written));
+        unsigned count = std::min<unsigned>(end, Capacity - Slack);
+        count = std::min<unsigned>(count, std::max(window, 0));
+        
+        out.resize(count);
+        
+        for (unsigned i = 0; i < count; ++i)
+            out[i] = entries[(end - count + i) % Capacity];
+    }
+};
+
 struct GraphicsPrivate {
     /* Screen resolution, ie. the resolution at which
      * RGSS renders at (settable with Graphics.resize_screen).
@@ -848,6 +975,13 @@ struct GraphicsPrivate {
     
     FPSLimiter fpsLimiter;
     
+    FrameTimeRing frameTimes;
+    
+    /* Timings of the frame being worked on */
+    FrameTimeRing::Entry frameTiming;
+    uint64_t lastUpdateEnd;
+    uint64_t lastFrameEnd;
+    
     // Can be set from Ruby. Takes priority over config setting.
     bool useFrameSkip;
     
@@ -869,6 +1003,39 @@ struct GraphicsPrivate {
     SDL_mutex *glResourceLock;
     bool multithreadedMode;
     
+    /* Thread holding glResourceLock via setLock(), and how
+     * many times it has taken it (the mutex is recursive) */
+    SDL_threadID lockOwner;
+    int lockDepth;
+    
+    /* In render thread mode, update() hands the frame over to
+     * 'renderThread', which composites and presents it under
+     * glResourceLock while the script carries on. Every binding
+     * touching graphics state takes that lock, so scene elements
+     * can't change under the render thread's feet */
+    SDL_Thread *renderThread;
+    SDL_mutex *renderMutex;
+    SDL_cond *renderCond;
+    bool renderQueued;
+    bool renderBusy;
+    bool renderQuit;
+    bool renderFailed;
+    FrameTimeRing::Entry queuedTiming;
+    
+    /* Custom shaders are Ruby objects, which the render thread
+     * can't touch; frames using any are presented serially */
+    bool customShadersInUse;
+    
+    /* Headless frame dumps still being written out */
+    std::deque<int> frameDumps;
+    
+    /* Frames read back by Graphics.capture_async */
+    ReadbackRing captures;
+    
+    /* Set by Graphics.start_recording; fed from
+     * whichever thread presents the frame */
+    VideoRecorder *recorder;
+    
     /* Global list of all live Disposables
      * (disposed on reset) */
     IntruList<Disposable> dispList;
@@ -882,10 +1049,15 @@ struct GraphicsPrivate {
     fpsLimiter(frameRate), useFrameSkip(rtData->config.frameSkip), frozen(false),
     last_update(0), last_avg_update(0), backingScaleFactor(1), integerScaleFactor(0, 0),
     integerScaleActive(rtData->config.integerScaling.active),
-    integerLastMileScaling(rtData->config.integerScaling.lastMileScaling) {
+    integerLastMileScaling(rtData->config.integerScaling.lastMileScaling),
+    captures(CAPTURE_SLOTS) {
         avgFPSData = std::vector<double>();
         avgFPSLock = SDL_CreateMutex();
         glResourceLock = SDL_CreateMutex();
+        memset(&frameTiming, 0, sizeof(frameTiming));
+        lastUpdateEnd = lastFrameEnd = SDL_GetPerformanceCounter();
+        lockOwner = 0;
+        lockDepth = 0;
         
         if (integerScaleActive) {
             integerScaleFactor = Vec2i(0, 0);
@@ -903,9 +1075,42 @@ struct GraphicsPrivate {
         screenQuad.setTexPosRect(screenRect, screenRect);
         
         fpsLimiter.resetFrameAdjust();
+        
+        renderThread = 0;
+        renderQueued = renderBusy = renderQuit = renderFailed = false;
+        customShadersInUse = false;
+        recorder = 0;
+        
+        const std::string &dumpDir = rtData->config.headless.frameDump;
+        
+        if (rtData->config.headless.enabled && !dumpDir.empty() &&
+            !mkxp_fs::createDirectory(dumpDir.c_str()))
+            Debug() << "Could not create frame dump directory" << dumpDir;
+        
+        if (rtData->config.renderThread) {
+            renderMutex = SDL_CreateMutex();
+            renderCond = SDL_CreateCond();
+            renderThread = createSDLThread
+                <GraphicsPrivate, &GraphicsPrivate::renderLoop>(this, "render");
+        }
     }
     
     ~GraphicsPrivate() {
+        if (renderThread) {
+            finishRender();
+            
+            SDL_LockMutex(renderMutex);
+            renderQuit = true;
+            SDL_CondBroadcast(renderCond);
+            SDL_UnlockMutex(renderMutex);
+            
+            SDL_WaitThread(renderThread, 0);
+            SDL_DestroyCond(renderCond);
+            SDL_DestroyMutex(renderMutex);
+        }
+        
+        delete recorder;
+        
         TEXFBO::fini(frozenScene);
         TEXFBO::fini(integerScaleBuffer);
         SDL_DestroyMutex(avgFPSLock);
@@ -1035,9 +1240,39 @@ struct GraphicsPrivate {
         scriptBinding->terminate();
     }
     
+    double ticksToMs(uint64_t ticks) const {
+        return (double)ticks * 1000 / fpsLimiter.tickFreq;
+    }
+    
+    /* Completes 'timing' with the time since the
+     * previous frame and publishes it */
+    void pushFrameTiming(FrameTimeRing::Entry &timing) {
+        uint64_t now = SDL_GetPerformanceCounter();
+        timing.ms[Graphics::FrameStats::Interval] = ticksToMs(now - lastFrameEnd);
+        lastFrameEnd = now;
+        
+        frameTimes.push(timing);
+    }
+    
+    /* Headless frames are composited but never shown */
+    void swapWindow() {
+        if (!threadData->config.headless.enabled)
+            SDL_GL_SwapWindow(threadData->window);
+    }
+    
     void swapGLBuffer() {
+        uint64_t start = SDL_GetPerformanceCounter();
         fpsLimiter.delay();
-        SDL_GL_SwapWindow(threadData->window);
+        
+        uint64_t slept = SDL_GetPerformanceCounter();
+        swapWindow();
+        
+        uint64_t swapped = SDL_GetPerformanceCounter();
+        PROFILE_RECORD("FPSLimiter::delay", start, slept);
+        PROFILE_RECORD("SDL_GL_SwapWindow", slept, swapped);
+        
+        frameTiming.ms[Graphics::FrameStats::Sleep] = ticksToMs(slept - start);
+        frameTiming.ms[Graphics::FrameStats::Present] = ticksToMs(swapped - slept);
         
         ++frameCount;
         
@@ -1070,9 +1305,17 @@ struct GraphicsPrivate {
                               !forceNearestNeighbor && threadData->config.smoothScaling);
     }
     
-    void redrawScreen() {
+    /* Composites the scene and draws it to the window,
+     * short of swapping buffers */
+    void drawScreen() {
+        PROFILE_ZONE("drawScreen");
+        
         screen.composite();
         
+        /* Nobody is looking at the window */
+        if (threadData->config.headless.enabled)
+            return;
+        
         // maybe unspaghetti this later
         if (integerScaleStepApplicable() && !integerLastMileScaling)
         {
@@ -1083,7 +1326,6 @@ struct GraphicsPrivate {
             metaBlitBufferFlippedScaled(scRes, true);
             GLMeta::blitEnd();
             
-            swapGLBuffer();
             return;
         }
         
@@ -1120,10 +1362,208 @@ struct GraphicsPrivate {
         metaBlitBufferFlippedScaled(sourceSize);
         
         GLMeta::blitEnd();
+    }
+    
+    void redrawScreen() {
+        uint64_t start = SDL_GetPerformanceCounter();
+        drawScreen();
+        frameTiming.ms[Graphics::FrameStats::Composite] = ticksToMs(SDL_GetPerformanceCounter() - start);
+        
+        recordFrame(screen.getPP().frontBuffer());
+        
+        if (threadData->config.headless.enabled)
+            dumpFrame();
         
         swapGLBuffer();
         
         updateAvgFPS();
+        
+        pushFrameTiming(frameTiming);
+        frameTiming.ms[Graphics::FrameStats::Script] = 0;
+    }
+    
+    /* Reads back every Nth composited frame and leaves
+     * the encoding to the image saver */
+    void dumpFrame() {
+        const Config &conf = threadData->config;
+        
+        if (conf.headless.frameDump.empty() ||
+            frameCount % conf.headless.frameDumpInterval != 0)
+            return;
+        
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%06d.png", frameCount);
+        
+        frameDumps.push_back(shState->imageSaver().save(screen.getPP().frontBuffer(),
+                                                        scRes.x, scRes.y,
+                                                        conf.headless.frameDump + name));
+    }
+    
+    void recordFrame(const TEXFBO &frame) {
+        if (recorder)
+            recorder->addFrame(frame, scRes.x, scRes.y);
+    }
+    
+    void collectFrameDumps() {
+        while (!frameDumps.empty()) {
+            std::string error;
+            ImageSaver::Status status = shState->imageSaver().status(frameDumps.front(), &error);
+            
+            if (status == ImageSaver::Pending)
+                break;
+            
+            if (status == ImageSaver::Failed)
+                Debug() << "Failed to dump frame:" << error;
+            
+            frameDumps.pop_front();
+        }
+    }
+    
+    bool renderThreadActive() const {
+        return renderThread && multithreadedMode && !renderFailed;
+    }
+    
+    void renderLoop() {
+        PROFILE_THREAD("Render");
+        
+        SDL_LockMutex(renderMutex);
+        
+        while (true) {
+            while (!renderQueued && !renderQuit)
+                SDL_CondWait(renderCond, renderMutex);
+            
+            if (renderQuit)
+                break;
+            
+            SDL_UnlockMutex(renderMutex);
+            SDL_LockMutex(glResourceLock);
+            
+            /* From here on, nobody else gets to touch the scene
+             * until the frame is done */
+            SDL_LockMutex(renderMutex);
+            renderQueued = false;
+            renderBusy = true;
+            FrameTimeRing::Entry timing = queuedTiming;
+            SDL_CondBroadcast(renderCond);
+            SDL_UnlockMutex(renderMutex);
+            
+            bool failed = false;
+            
+            if (SDL_GL_MakeCurrent(threadData->window, glCtx) == 0) {
+                uint64_t start = SDL_GetPerformanceCounter();
+                drawScreen();
+                recordFrame(screen.getPP().frontBuffer());
+                
+                /* The scene has been read, so scripts may change it
+                 * while we wait on vsync. The context stays ours until
+                 * 'renderBusy' is cleared, which setLock() waits for */
+                SDL_UnlockMutex(glResourceLock);
+                
+                uint64_t drawn = SDL_GetPerformanceCounter();
+                swapWindow();
+                updateAvgFPS();
+                
+                uint64_t swapped = SDL_GetPerformanceCounter();
+                PROFILE_RECORD("SDL_GL_SwapWindow", drawn, swapped);
+                
+                timing.ms[Graphics::FrameStats::Composite] = ticksToMs(drawn - start);
+                timing.ms[Graphics::FrameStats::Present] = ticksToMs(swapped - drawn);
+                pushFrameTiming(timing);
+                
+                SDL_GL_MakeCurrent(threadData->window, 0);
+            } else {
+                Debug() << "Render thread could not take over the GL context:" << SDL_GetError();
+                failed = true;
+                
+                SDL_UnlockMutex(glResourceLock);
+            }
+            
+            SDL_LockMutex(renderMutex);
+            renderBusy = false;
+            renderFailed = renderFailed || failed;
+            SDL_CondBroadcast(renderCond);
+        }
+        
+        SDL_UnlockMutex(renderMutex);
+    }
+    
+    /* Blocks until the render thread has taken the frame
+     * handed to it, so that whoever locks glResourceLock next
+     * sees the scene only after it was composited */
+    void waitRenderStarted() {
+        /* Nothing can have started while we hold the lock */
+        if (lockOwner == SDL_ThreadID())
+            return;
+        
+        SDL_LockMutex(renderMutex);
+        
+        while (renderQueued)
+            SDL_CondWait(renderCond, renderMutex);
+        
+        SDL_UnlockMutex(renderMutex);
+    }
+    
+    /* Blocks until the render thread is done presenting and has
+     * let go of the GL context. Once glResourceLock is ours, it
+     * can at most be swapping buffers, so this doesn't deadlock */
+    void waitContextReleased() {
+        SDL_LockMutex(renderMutex);
+        
+        while (renderBusy)
+            SDL_CondWait(renderCond, renderMutex);
+        
+        SDL_UnlockMutex(renderMutex);
+    }
+    
+    /* Blocks until no frame is in flight anymore, letting go of
+     * glResourceLock meanwhile in case the caller holds it */
+    void waitRenderIdle() {
+        int held = (lockOwner == SDL_ThreadID()) ? lockDepth : 0;
+        
+        for (int i = 0; i < held; ++i)
+            SDL_UnlockMutex(glResourceLock);
+        
+        SDL_LockMutex(renderMutex);
+        
+        while (renderQueued || renderBusy)
+            SDL_CondWait(renderCond, renderMutex);
+        
+        SDL_UnlockMutex(renderMutex);
+        
+        for (int i = 0; i < held; ++i)
+            SDL_LockMutex(glResourceLock);
+    }
+    
+    /* Must precede any GL work on the RGSS thread outside
+     * of setLock() while the render thread exists */
+    void finishRender() {
+        if (!renderThread)
+            return;
+        
+        waitRenderIdle();
+        
+        if (SDL_GL_GetCurrentContext() != glCtx)
+            SDL_GL_MakeCurrent(threadData->window, glCtx);
+    }
+    
+    /* Paces the frame like swapGLBuffer(), then hands
+     * compositing and presenting it to the render thread */
+    void queueFrame() {
+        uint64_t start = SDL_GetPerformanceCounter();
+        fpsLimiter.delay();
+        frameTiming.ms[Graphics::FrameStats::Sleep] = ticksToMs(SDL_GetPerformanceCounter() - start);
+        
+        ++frameCount;
+        threadData->ethread->notifyFrame();
+        
+        /* A context can only be current on one thread */
+        SDL_GL_MakeCurrent(threadData->window, 0);
+        
+        SDL_LockMutex(renderMutex);
+        renderQueued = true;
+        queuedTiming = frameTiming;
+        SDL_CondSignal(renderCond);
+        SDL_UnlockMutex(renderMutex);
     }
     
     void checkSyncLock() {
@@ -1154,13 +1594,26 @@ struct GraphicsPrivate {
     void setLock(bool force = false) {
         if (!(force || multithreadedMode)) return;
         
+        if (renderThread)
+            waitRenderStarted();
+        
         SDL_LockMutex(glResourceLock);
+        
+        if (lockDepth == 0 && renderThread)
+            waitContextReleased();
+        
+        lockOwner = SDL_ThreadID();
+        ++lockDepth;
+        
         SDL_GL_MakeCurrent(threadData->window, threadData->glContext);
     }
     
     void releaseLock(bool force = false) {
         if (!(force || multithreadedMode)) return;
         
+        if (--lockDepth == 0)
+            lockOwner = 0;
+        
         SDL_UnlockMutex(glResourceLock);
     }
 
@@ -1181,10 +1634,10 @@ Graphics::Graphics(RGSSThreadData *data) {
     if (data->config.syncToRefreshrate) {
         p->frameRate = data->refreshRate;
         p->fpsLimiter.disabled = true;
+    } else if (data->config.uncappedFramerate) {
+        p->fpsLimiter.disabled = true;
     } else if (data->config.fixedFramerate > 0) {
         p->fpsLimiter.setDesiredFPS(data->config.fixedFramerate);
-    } else if (data->config.fixedFramerate < 0) {
-        p->fpsLimiter.disabled = true;
     }
 }
 
@@ -1199,6 +1652,14 @@ double Graphics::lastUpdate() {
 }
 
 void Graphics::update(bool checkForShutdown) {
+    /* Everything since the last update counts as script time */
+    uint64_t updateStart = SDL_GetPerformanceCounter();
+    p->frameTiming.ms[FrameStats::Script] = p->ticksToMs(updateStart - p->lastUpdateEnd);
+    PROFILE_RECORD("Script", p->lastUpdateEnd, updateStart);
+    
+    PROFILE_ZONE("Graphics.update");
+    
+    p->finishRender();
     p->threadData->rqWindowAdjust.wait();
     p->last_update = shState->runTime();
     
@@ -1216,14 +1677,19 @@ void Graphics::update(bool checkForShutdown) {
     
     p->checkSyncLock();
     
+    shState->imageSaver().poll();
+    p->collectFrameDumps();
+    p->captures.poll();
     
 #ifdef MKXPZ_STEAM
     if (STEAMSHIM_alive())
         STEAMSHIM_pump();
 #endif
     
-    if (p->frozen)
+    if (p->frozen) {
+        p->lastUpdateEnd = SDL_GetPerformanceCounter();
         return;
+    }
     
     if (p->fpsLimiter.frameSkipRequired()) {
         if (p->useFrameSkip) {
@@ -1232,6 +1698,7 @@ void Graphics::update(bool checkForShutdown) {
             ++p->frameCount;
             p->threadData->ethread->notifyFrame();
             
+            p->lastUpdateEnd = SDL_GetPerformanceCounter();
             return;
         } else {
             /* Just reset frame adjust counter */
@@ -1240,10 +1707,28 @@ void Graphics::update(bool checkForShutdown) {
     }
     
     p->checkResize();
-    p->redrawScreen();
+    
+    if (p->renderThreadActive() && !p->customShadersInUse)
+        p->queueFrame();
+    else
+        p->redrawScreen();
+    
+    p->lastUpdateEnd = SDL_GetPerformanceCounter();
+}
+
+void Graphics::checkCustomShaders() {
+    if (!p->renderThreadActive())
+        return;
+    
+    p->customShadersInUse = p->screen.containsCustomShaders();
+}
+
+bool Graphics::onRenderThread() const {
+    return p->renderThread && SDL_ThreadID() == SDL_GetThreadID(p->renderThread);
 }
 
 void Graphics::freeze() {
+    p->finishRender();
     p->frozen = true;
     
     p->checkShutDownReset();
@@ -1254,6 +1739,7 @@ void Graphics::freeze() {
 }
 
 void Graphics::transition(int duration, const char *filename, int vague) {
+    p->finishRender();
     p->checkSyncLock();
     
     if (!p->frozen)
@@ -1346,6 +1832,7 @@ void Graphics::transition(int duration, const char *filename, int vague) {
         p->metaBlitBufferFlippedScaled();
         GLMeta::blitEnd();
         
+        p->recordFrame(transBuffer);
         p->swapGLBuffer();
         /* Call this manually, as redrawScreen() is not called during this loop. */
         p->updateAvgFPS();
@@ -1383,7 +1870,48 @@ double Graphics::averageFrameRate() {
     return p->averageFPS();
 }
 
+Graphics::PacingStats Graphics::pacingStats() const {
+    return p->fpsLimiter.stats;
+}
+
+/* Nearest-rank percentile of sorted 'values' */
+static double percentile(const std::vector<float> &values, double fraction) {
+    size_t rank = (size_t)std::ceil(fraction * values.size());
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+Graphics::FrameStats Graphics::frameStats(int window) const {
+    std::vector<FrameTimeRing::Entry> entries;
+    p->frameTimes.snapshot(entries, window);
+    
+    FrameStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.frames = entries.size();
+    
+    if (entries.empty())
+        return stats;
+    
+    std::vector<float> values(entries.size());
+    
+    for (int phase = 0; phase < FrameStats::PhaseCount; ++phase) {
+        for (size_t i = 0; i < entries.size(); ++i)
+            values[i] = entries[i].ms[phase];
+        
+        std::sort(values.begin(), values.end());
+        
+        FrameStats::Summary &sum = stats.phases[phase];
+        sum.p50 = percentile(values, 0.5);
+        sum.p90 = percentile(values, 0.9);
+        sum.p99 = percentile(values, 0.99);
+        sum.max = values.back();
+    }
+    
+    return stats;
+}
+
 void Graphics::wait(int duration) {
+    p->finishRender();
+    
     for (int i = 0; i < duration; ++i) {
         p->checkShutDownReset();
         p->redrawScreen();
@@ -1391,6 +1919,7 @@ void Graphics::wait(int duration) {
 }
 
 void Graphics::fadeout(int duration) {
+    p->finishRender();
     FBO::unbind();
     
     float curr = p->brightness;
@@ -1408,6 +1937,7 @@ void Graphics::fadeout(int duration) {
             
             GLMeta::blitEnd();
             
+            p->recordFrame(p->frozenScene);
             p->swapGLBuffer();
         } else {
             update();
@@ -1416,6 +1946,7 @@ void Graphics::fadeout(int duration) {
 }
 
 void Graphics::fadein(int duration) {
+    p->finishRender();
     FBO::unbind();
     
     float curr = p->brightness;
@@ -1433,6 +1964,7 @@ void Graphics::fadein(int duration) {
             
             GLMeta::blitEnd();
             
+            p->recordFrame(p->frozenScene);
             p->swapGLBuffer();
         } else {
             update();
@@ -1441,6 +1973,8 @@ void Graphics::fadein(int duration) {
 }
 
 Bitmap *Graphics::snapToBitmap() {
+    p->finishRender();
+    
     Bitmap *bitmap = new Bitmap(width(), height());
     
     p->compositeToBuffer(bitmap->getGLTypes());
@@ -1450,6 +1984,75 @@ Bitmap *Graphics::snapToBitmap() {
     return bitmap;
 }
 
+int Graphics::captureAsync() {
+    p->finishRender();
+    
+    /* While frozen, the player keeps seeing the frozen scene */
+    const TEXFBO &frame = p->frozen ? p->frozenScene : p->screen.getPP().frontBuffer();
+    
+    return p->captures.read(frame, p->scRes.x, p->scRes.y);
+}
+
+bool Graphics::captureReady(int handle) {
+    p->finishRender();
+    p->captures.poll();
+    
+    return p->captures.status(handle) == ReadbackRing::Done;
+}
+
+Bitmap *Graphics::captureResult(int handle) {
+    p->finishRender();
+    p->captures.poll();
+    
+    std::vector<uint8_t> pixels;
+    int w, h;
+    
+    if (!p->captures.fetch(handle, pixels, w, h))
+        return 0;
+    
+    Bitmap *bitmap = new Bitmap(w, h);
+    bitmap->replaceRaw(&pixels[0], pixels.size());
+    
+    return bitmap;
+}
+
+void Graphics::startRecording(const char *path, bool raw) {
+    p->finishRender();
+    
+    if (p->recorder)
+        throw Exception(Exception::MKXPError, "Already recording video");
+    
+    p->recorder = new VideoRecorder(path, raw ? VideoRecorder::Raw : VideoRecorder::Y4M,
+                                    p->scRes.x, p->scRes.y, p->frameRate);
+}
+
+bool Graphics::stopRecording(int &written, int &dropped) {
+    p->finishRender();
+    
+    if (!p->recorder)
+        return false;
+    
+    VideoRecorder *recorder = p->recorder;
+    p->recorder = 0;
+    
+    try {
+        VideoRecorder::Stats stats = recorder->finish();
+        written = stats.written;
+        dropped = stats.dropped;
+    } catch (const Exception &e) {
+        delete recorder;
+        throw e;
+    }
+    
+    delete recorder;
+    
+    Debug() << "Recorded" << written << "frames of video," << dropped << "dropped";
+    
+    return true;
+}
+
+bool Graphics::isRecording() const { return p->recorder != 0; }
+
 int Graphics::width() const { return p->scRes.x; }
 
 int Graphics::height() const { return p->scRes.y; }
@@ -1467,6 +2070,7 @@ int Graphics::displayHeight() const {
 }
 
 void Graphics::resizeScreen(int width, int height) {
+    p->finishRender();
     p->threadData->rqWindowAdjust.wait();
     p->checkResize(true);
     
@@ -1523,6 +2127,10 @@ void Graphics::playMovie(const char *filename, int volume_, bool skippable, void
         movieSprite.setBitmap(movie->videoBitmap);
         // Pass around void* because trying to include in graphics.h to have access to VALUE is a compilation nightmare
         if(shaderArr != 0) movieSprite.setShaderArr(*reinterpret_cast<VALUE*>(shaderArr));
+        
+        /* Nothing rescans the scene while the movie plays */
+        if (shaderArr != 0)
+            p->customShadersInUse = true;
 
         double ratio = std::min((double)width() / movie->video->width, (double)height() / movie->video->height);
         movieSprite.setZoomX(ratio);
@@ -1552,6 +2160,19 @@ void Graphics::screenshot(const char *filename) {
     delete ss;
 }
 
+int Graphics::screenshotAsync(const char *filename) {
+    p->threadData->rqWindowAdjust.wait();
+    Bitmap *ss = snapToBitmap();
+    
+    /* The readback is already queued on the GPU
+     * when the bitmap's texture is returned */
+    int ticket = ss->saveToFileAsync(filename);
+    ss->dispose();
+    delete ss;
+    
+    return ticket;
+}
+
 DEF_ATTR_RD_SIMPLE(Graphics, Brightness, int, p->brightness)
 
 void Graphics::setBrightness(int value) {
@@ -1565,6 +2186,8 @@ void Graphics::setBrightness(int value) {
 }
 
 void Graphics::reset() {
+    p->finishRender();
+    
     /* Dispose all live Disposables */
     IntruListLink<Disposable> *iter;
     
@@ -1676,6 +2299,11 @@ bool Graphics::getThreadsafe() const
 
 void Graphics::setThreadsafe(bool value)
 {
+    /* Without the lock, the render thread can't run
+     * alongside scripts */
+    if (!value)
+        p->finishRender();
+    
     p->multithreadedMode = value;
 }
 
@@ -1721,7 +2349,7 @@ void Graphics::repaintWait(const AtomicFlag &exitCond, bool checkReset) {
         
         FBO::clear();
         p->metaBlitBufferFlippedScaled();
-        SDL_GL_SwapWindow(p->threadData->window);
+        p->swapWindow();
         p->fpsLimiter.delay();
         
         p->threadData->ethread->notifyFrame();
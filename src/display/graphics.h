@@ -24,6 +24,8 @@
 
 #include "util.h"
 
+#include <stdint.h>
+
 class Scene;
 class Bitmap;
 class Disposable;
@@ -40,6 +42,13 @@ public:
     double lastUpdate();
     
 	void update(bool checkForShutdown = true);
+
+	/* Frames with custom shaders in the scene are presented
+	 * on the calling thread rather than the render thread,
+	 * which must not touch Ruby objects. Needs the GVL, and
+	 * is called before each update() */
+	void checkCustomShaders();
+	bool onRenderThread() const;
 	void freeze();
 	void transition(int duration = 8,
 	                const char *filename = "",
@@ -56,6 +65,25 @@ public:
 
 	Bitmap *snapToBitmap();
 
+	/* Reads back the last composited frame without waiting
+	 * on the GPU. The returned handle is usually ready a
+	 * frame or two later; a handful of captures can be in
+	 * flight, after which the oldest unfetched one is dropped */
+	int captureAsync();
+	bool captureReady(int handle);
+
+	/* Returns 0 while the capture is pending or if the
+	 * handle is unknown; afterwards the handle is forgotten */
+	Bitmap *captureResult(int handle);
+
+	/* Streams every presented frame to 'path' as Y4M
+	 * video, or as raw RGBA frames if 'raw' is set */
+	void startRecording(const char *path, bool raw);
+
+	/* Returns false if nothing was being recorded */
+	bool stopRecording(int &written, int &dropped);
+	bool isRecording() const;
+
 	int width() const;
 	int height() const;
     int displayWidth() const;
@@ -66,6 +94,7 @@ public:
 	bool updateMovieInput(Movie *movie);
 	void playMovie(const char *filename, int volume, bool skippable, void *shaderArr);
 	void screenshot(const char *filename);
+	int screenshotAsync(const char *filename);
 
 	void reset();
     void center();
@@ -82,6 +111,53 @@ public:
     DECL_ATTR( Threadsafe, bool )
     double averageFrameRate();
 
+	/* Covers every frame the pacer waited for: how many were
+	 * already late before waiting, how many it woke up late
+	 * for, and how far frame times strayed from the target.
+	 * histogram[i] counts deviations below bucketLimitsUs[i],
+	 * the last bucket everything beyond */
+	struct PacingStats
+	{
+		enum { Buckets = 8 };
+		static const int bucketLimitsUs[Buckets - 1];
+
+		uint64_t frames;
+		uint64_t missed;
+		uint64_t overslept;
+		uint64_t histogram[Buckets];
+	};
+
+	PacingStats pacingStats() const;
+
+	/* Percentiles of the CPU time spent per frame in each
+	 * phase, in milliseconds, over the most recent frames.
+	 * 'Interval' is the wall clock time between frames */
+	struct FrameStats
+	{
+		enum Phase
+		{
+			Script,
+			Composite,
+			Present,
+			Sleep,
+			Interval,
+
+			PhaseCount
+		};
+
+		struct Summary
+		{
+			double p50, p90, p99, max;
+		};
+
+		int frames;
+		Summary phases[PhaseCount];
+	};
+
+	/* Covers at most 'window' frames; lock-free,
+	 * callable from any thread */
+	FrameStats frameStats(int window) const;
+
 	/* <internal> */
 	Scene *getScreen() const;
 	/* Repaint screen with static image until exitCond
@@ -62,6 +62,8 @@ struct PlanePrivate
 	bool quadSourceDirty;
 
 	SimpleQuadArray qArray;
+	/* Quads drawn per mega tile */
+	size_t repetitions;
 
 	EtcTemps tmp;
 
@@ -78,6 +80,7 @@ struct PlanePrivate
 	      ox(0), oy(0),
 	      zoomX(1), zoomY(1),
 	      quadSourceDirty(false),
+	      repetitions(1),
 		  shaderArr(0)
 	{
 		prepareCon = shState->prepareDraw.connect
@@ -91,9 +94,16 @@ struct PlanePrivate
 		prepareCon.disconnect();
 	}
 
+	/* Mega bitmaps are split over several textures,
+	 * so they can't be wrapped by the sampler */
+	bool repeatWrap() const
+	{
+		return gl.npot_repeat && !(!nullOrDisposed(bitmap) && bitmap->isMega());
+	}
+
 	void updateQuadSource()
 	{
-		if (gl.npot_repeat)
+		if (repeatWrap())
 		{
 			FloatRect srcRect;
 			srcRect.x = (sceneGeo.orig.x + ox) / zoomX;
@@ -101,7 +111,8 @@ struct PlanePrivate
 			srcRect.w = sceneGeo.rect.w / zoomX;
 			srcRect.h = sceneGeo.rect.h / zoomY;
 
-			Quad::setTexRect(&qArray.vertices[0], srcRect);
+			qArray.resize(1);
+			Quad::setTexPosRect(&qArray.vertices[0], srcRect, FloatRect(sceneGeo.rect));
 			qArray.commit();
 
 			return;
@@ -126,22 +137,43 @@ struct PlanePrivate
 		size_t tilesX = ceil((vpw - sw + wox) / sw) + 1;
 		size_t tilesY = ceil((vph - sh + woy) / sh) + 1;
 
-		FloatRect tex = bitmap->rect();
-
-		qArray.resize(tilesX * tilesY);
+		/* Mega bitmaps repeat each of their tiles separately;
+		 * quads are grouped by tile so every group can be
+		 * drawn with its own texture bound */
+		bool mega = bitmap->isMega();
+		size_t parts = mega ? bitmap->megaTileCount() : 1;
 
-		for (size_t y = 0; y < tilesY; ++y)
-			for (size_t x = 0; x < tilesX; ++x)
-			{
-				SVertex *vert = &qArray.vertices[(y*tilesX + x) * 4];
-				FloatRect pos(x*sw - wox, y*sh - woy, sw, sh);
+		repetitions = tilesX * tilesY;
+		qArray.resize(repetitions * parts);
 
-				Quad::setTexPosRect(vert, tex, pos);
-			}
+		for (size_t t = 0; t < parts; ++t)
+		{
+			IntRect part = mega ? bitmap->megaTileRect(t) : bitmap->rect();
+			FloatRect tex(0, 0, part.w, part.h);
+
+			for (size_t y = 0; y < tilesY; ++y)
+				for (size_t x = 0; x < tilesX; ++x)
+				{
+					SVertex *vert = &qArray.vertices[(t*repetitions + y*tilesX + x) * 4];
+					FloatRect pos(x*sw - wox + part.x*zoomX, y*sh - woy + part.y*zoomY,
+					              part.w*zoomX, part.h*zoomY);
+
+					Quad::setTexPosRect(vert, tex, pos);
+				}
+		}
 
 		qArray.commit();
 	}
 
+	void drawMegaTiles(ShaderBase &base)
+	{
+		for (int t = 0; t < bitmap->megaTileCount(); ++t)
+		{
+			bitmap->bindMegaTile(t, base);
+			qArray.draw(t*repetitions, repetitions);
+		}
+	}
+
 	void prepare()
 	{
 		if (quadSourceDirty)
@@ -200,11 +232,7 @@ void Plane::setBitmap(Bitmap *value)
 	guardDisposed();
 
 	p->bitmap = value;
-
-	if (!value)
-		return;
-
-	value->ensureNonMega();
+	p->quadSourceDirty = true;
 }
 
 void Plane::setOX(int value)
@@ -276,6 +304,11 @@ void Plane::initDynAttribs()
 	p->tone = new Tone;
 }
 
+bool Plane::hasCustomShaders()
+{
+	return p->shaderArr && rb_array_len(p->shaderArr) > 0;
+}
+
 void Plane::draw()
 {
 	if (nullOrDisposed(p->bitmap))
@@ -311,11 +344,22 @@ void Plane::draw()
 	}
 
 	glState.blendMode.pushSet(p->blendType);
-	p->bitmap->bindTex(*base);
+
+	/* Custom shader stacks need a single source
+	 * texture, which mega bitmaps don't have */
+	if (p->bitmap->isMega())
+	{
+		p->drawMegaTiles(*base);
+		glState.blendMode.pop();
+		return;
+	}
+
+	/* Wrapping samplers need the frame in a texture of its own */
+	p->bitmap->bindTex(*base, gl.npot_repeat);
 
 	if(p->shaderArr)
 	{
-		long size = rb_array_len(p->shaderArr);
+		long size = shaderArrayLength(p->shaderArr);
 		if (size > 0) {
 			// Store the current FBO used, as FBO::unbind() will set it to 0 which is not correct
 			GLint originalFbo = 0;
@@ -361,12 +405,12 @@ void Plane::draw()
 		}
 	}
 
-	if (gl.npot_repeat)
+	if (p->repeatWrap())
 		TEX::setRepeat(true);
 
 	p->qArray.draw();
 
-	if (gl.npot_repeat)
+	if (p->repeatWrap())
 		TEX::setRepeat(false);
 
 	glState.blendMode.pop();
@@ -374,9 +418,6 @@ void Plane::draw()
 
 void Plane::onGeometryChange(const Scene::Geometry &geo)
 {
-	if (gl.npot_repeat)
-		Quad::setPosRect(&p->qArray.vertices[0], FloatRect(geo.rect));
-
 	p->sceneGeo = geo;
 	p->quadSourceDirty = true;
 }
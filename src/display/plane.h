@@ -54,6 +54,7 @@ private:
 	PlanePrivate *p;
 
 	void draw();
+	bool hasCustomShaders();
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
@@ -4,6 +4,7 @@
 #include "binding-util.h"
 #include "sharedstate.h"
 #include "shader.h"
+#include "programcache.h"
 #include "bitmap.h"
 
 #ifndef MKXPZ_BUILD_XCODE
@@ -11,7 +12,58 @@
 #endif
 
 #include <string>
-#include <map>
+#include <string.h>
+
+/* Fills in the parts making up the full source of a
+ * shader; returns their count (at most 3) */
+static size_t shaderSourceParts(const char *contents, bool vert,
+                                const GLchar **shaderSrc, GLint *shaderSrcSize)
+{
+    static const char glesDefine[] = "#define GLSLES\n";
+    static const char fragDefine[] = "#define FRAGMENT_SHADER\n";
+
+    size_t i = 0;
+
+    if (gl.glsles)
+    {
+        shaderSrc[i] = glesDefine;
+        shaderSrcSize[i] = sizeof(glesDefine) - 1;
+        ++i;
+    }
+
+    if (!vert)
+    {
+        shaderSrc[i] = fragDefine;
+        shaderSrcSize[i] = sizeof(fragDefine) - 1;
+        ++i;
+    }
+
+    shaderSrc[i] = (const GLchar *)contents;
+    shaderSrcSize[i] = strlen(contents);
+    ++i;
+
+    return i;
+}
+
+static ProgramCache::Key programKey(const char *contents, const char *vertContents)
+{
+    const GLchar *shaderSrc[3];
+    GLint shaderSrcSize[3];
+    size_t count;
+
+    ProgramCache::Key key;
+    key.add("custom");
+
+    count = shaderSourceParts(vertContents, true, shaderSrc, shaderSrcSize);
+    for (size_t i = 0; i < count; ++i)
+        key.add(shaderSrc[i], shaderSrcSize[i]);
+
+    count = shaderSourceParts(contents, false, shaderSrc, shaderSrcSize);
+    for (size_t i = 0; i < count; ++i)
+        key.add(shaderSrc[i], shaderSrcSize[i]);
+
+    return key;
+}
 
 #ifdef MKXPZ_BUILD_XCODE
 #include "filesystem/filesystem.h"
@@ -27,8 +79,15 @@ CompiledShader::CompiledShader(const char *contents, VALUE args) : contents(cont
 
     program = gl.CreateProgram();
 
-    compileShader(contents, fragShader, program, false);
-    compileShader(vertContents, vertShader, program, true);
+    ProgramCache::Key key = programKey(contents, vertContents);
+
+    if (!ProgramCache::load(program, key))
+    {
+        compileShader(contents, fragShader, program, false);
+        compileShader(vertContents, vertShader, program, true);
+        ProgramCache::store(program, key);
+    }
+
     setupArgs(args);
 
     ShaderBase::init();
@@ -42,8 +101,15 @@ CompiledShader::CompiledShader(const char *contents, VALUE args, const char *ver
 
     program = gl.CreateProgram();
 
-    compileShader(contents, fragShader, program, false);
-    compileShader(vertContents, vertShader, program, true);
+    ProgramCache::Key key = programKey(contents, vertContents);
+
+    if (!ProgramCache::load(program, key))
+    {
+        compileShader(contents, fragShader, program, false);
+        compileShader(vertContents, vertShader, program, true);
+        ProgramCache::store(program, key);
+    }
+
     setupArgs(args);
 
     ShaderBase::init();
@@ -73,32 +139,11 @@ std::string getProgramLog(GLuint shader)
 
 void CompiledShader::setupShaderSource(const char *contents, GLuint shader, bool vert)
 {
-    static const char glesDefine[] = "#define GLSLES\n";
-    static const char fragDefine[] = "#define FRAGMENT_SHADER\n";
-
     const GLchar *shaderSrc[3];
     GLint shaderSrcSize[3];
-    size_t i = 0;
+    size_t count = shaderSourceParts(contents, vert, shaderSrc, shaderSrcSize);
 
-    if (gl.glsles)
-    {
-        shaderSrc[i] = glesDefine;
-        shaderSrcSize[i] = sizeof(glesDefine) - 1;
-        ++i;
-    }
-
-    if (!vert)
-    {
-        shaderSrc[i] = fragDefine;
-        shaderSrcSize[i] = sizeof(fragDefine) - 1;
-        ++i;
-    }
-
-    shaderSrc[i] = (const GLchar *)contents;
-    shaderSrcSize[i] = strlen(contents);
-    ++i;
-
-    gl.ShaderSource(shader, i, shaderSrc, shaderSrcSize);
+    gl.ShaderSource(shader, count, shaderSrc, shaderSrcSize);
 }
 
 void CompiledShader::compileShader(const char *contents, GLuint shader, GLuint program, bool vert)
@@ -125,6 +170,7 @@ void CompiledShader::compileShader(const char *contents, GLuint shader, GLuint p
     // Alternatively, one may call LinkProgram() and do the error checking in every place where this compileShader()
     // method is called.
     if (vert) {
+        ProgramCache::prepare(program);
         gl.LinkProgram(program);
         gl.GetProgramiv(program, GL_LINK_STATUS, &success);
 
@@ -139,13 +185,17 @@ void CompiledShader::compileShader(const char *contents, GLuint shader, GLuint p
 void CompiledShader::setupArgs(VALUE pargs)
 {
     long argc = rb_array_len(pargs);
-    args = std::map<const char *, GLint>();
+    args.clear();
+    args.reserve(argc);
 
     for (long i = 0; i < argc; ++i)
     {
-        VALUE arg = rb_ary_entry(pargs, i);
-        const char *name = rb_string_value_cstr(&arg);
-        args[name] = gl.GetUniformLocation(program, name);
+        Arg arg;
+        arg.key = rb_ary_entry(pargs, i);
+        arg.name = rb_string_value_cstr(&arg.key);
+        arg.location = gl.GetUniformLocation(program, arg.name.c_str());
+
+        args.push_back(arg);
     }
 }
 
@@ -159,7 +209,7 @@ const char *CompiledShader::getVertContents()
     return vertContents;
 }
 
-std::map<const char *, GLint> CompiledShader::getArgs()
+const std::vector<CompiledShader::Arg> &CompiledShader::getArgs() const
 {
     return args;
 }
@@ -169,6 +219,43 @@ GLuint CompiledShader::getProgram()
     return program;
 }
 
+GLint CompiledShader::uniformLocation(const char *name)
+{
+    for (size_t i = 0; i < locations.size(); ++i)
+        if (!strcmp(locations[i].first.c_str(), name))
+            return locations[i].second;
+
+    GLint location = gl.GetUniformLocation(program, name);
+    locations.push_back(std::make_pair(std::string(name), location));
+
+    return location;
+}
+
+void CompiledShader::setFloat(GLint location, float value)
+{
+    setFloatUniform(location, value);
+}
+
+void CompiledShader::setInteger(GLint location, int value)
+{
+    setIntUniform(location, value);
+}
+
+void CompiledShader::setVec2(GLint location, const Vec2 &value)
+{
+    setVec2Uniform(location, value);
+}
+
+void CompiledShader::setVec4(GLint location, const Vec4 &value)
+{
+    setVec4Uniform(location, value);
+}
+
+void CompiledShader::setMatrix4(GLint location, const float value[16])
+{
+    setMat4Uniform(location, value);
+}
+
 CustomShader::CustomShader(CompiledShader *shader, VALUE args, VALUE texUnits) : shader(shader),
                                                                                  args(args), texUnits(texUnits),
                                                                                  phase(0)
@@ -177,7 +264,7 @@ CustomShader::CustomShader(CompiledShader *shader, VALUE args, VALUE texUnits) :
 
 GLint CustomShader::getUniform(const char *name)
 {
-    return gl.GetUniformLocation(shader->getProgram(), name);
+    return shader->uniformLocation(name);
 }
 
 
@@ -188,83 +275,100 @@ bool CustomShader::supportsVariable(const char *name)
 
 void CustomShader::setMatrix4(const char *name, const float value[16])
 {
-    GLint u_name = getUniform(name);
-    if(u_name != -1)
-        gl.UniformMatrix4fv(u_name, 1, GL_FALSE, value);
+    shader->setMatrix4(getUniform(name), value);
 }
 
 void CustomShader::setVec4(const char *name, const Vec4 &value)
 {
-    GLint u_name = getUniform(name);
-    if(u_name != -1)
-        gl.Uniform4f(u_name, value.x, value.y, value.z, value.w);
+    shader->setVec4(getUniform(name), value);
 }
 
 void CustomShader::setFloat(const char *name, const float value)
 {
-    GLint u_name = getUniform(name);
-    if(u_name != -1)
-        gl.Uniform1f(u_name, value);
+    shader->setFloat(getUniform(name), value);
 }
 
 void CustomShader::setInteger(const char *name, const int value)
 {
-    GLint u_name = getUniform(name);
-    if(u_name != -1)
-        gl.Uniform1i(u_name, value);
+    shader->setInteger(getUniform(name), value);
+}
+
+/* Argument classes, looked up once; being
+ * constants, they are never collected */
+struct ArgClasses
+{
+    VALUE flt, integer, vec2, vec4, bitmap;
+};
+
+static const ArgClasses &argClasses()
+{
+    static ArgClasses classes = { 0, 0, 0, 0, 0 };
+
+    if (!classes.flt)
+    {
+        classes.flt = rb_path2class("Float");
+        classes.integer = rb_path2class("Integer");
+        classes.vec2 = rb_path2class("Vec2");
+        classes.vec4 = rb_path2class("Vec4");
+        classes.bitmap = rb_path2class("Bitmap");
+    }
+
+    return classes;
 }
 
-#define IS_A(klass) if ( \
-    rb_obj_is_kind_of(   \
-        value,           \
-        rb_path2class(klass)))
+#define IS_A(klass) if (RTEST(rb_obj_is_kind_of(value, klass)))
 
 void CustomShader::applyArgs()
 {
-    std::map<const char *, GLint> args = shader->getArgs();
-    std::map<const char *, GLint>::iterator it;
-    for (it = args.begin(); it != args.end(); it++)
+    const ArgClasses &classes = argClasses();
+    const std::vector<CompiledShader::Arg> &args = shader->getArgs();
+
+    for (size_t i = 0; i < args.size(); ++i)
     {
-        VALUE value = rb_hash_aref(this->args, rb_str_new_cstr(it->first));
+        const CompiledShader::Arg &arg = args[i];
+        const char *name = arg.name.c_str();
+
+        /* Frozen key, so the lookup doesn't allocate */
+        VALUE value = rb_hash_aref(this->args, arg.key);
 
         if (value == Qnil)
-            rb_raise(rb_eIndexError, "No such argument: %s", it->first);
+            rb_raise(rb_eIndexError, "No such argument: %s", name);
 
-        if (it->second == -1)
-            rb_raise(rb_eIndexError, "No such uniform declared in shader: %s", it->first);
+        if (arg.location == -1)
+            rb_raise(rb_eIndexError, "No such uniform declared in shader: %s", name);
 
-        IS_A("Float")
+        IS_A(classes.flt)
         {
             double floatUniform;
-            if (it->first[0] == '_') {
+            if (name[0] == '_') {
                 // Assume this is the _time uniform. The value in the hash actually represents the max value before
                 // looping, while the value passed in is calculated based on runtime, 60FPS, and that value.
                 floatUniform = fmod((shState->runTime() * 60.0), NUM2DBL(value));
             } else {
                 floatUniform = NUM2DBL(value);
             }
-            gl.Uniform1f(it->second, floatUniform);
+            shader->setFloat(arg.location, floatUniform);
         }
-        else IS_A("Integer")
+        else IS_A(classes.integer)
         {
-            gl.Uniform1i(it->second, NUM2INT(value));
+            shader->setInteger(arg.location, NUM2INT(value));
         }
-        else IS_A("Vec2")
+        else IS_A(classes.vec2)
         {
             Vec2 *vec2 = getPrivateData<Vec2>(value);
-            gl.Uniform2f(it->second, vec2->x, vec2->y);
+            shader->setVec2(arg.location, *vec2);
         }
-        else IS_A("Vec4")
+        else IS_A(classes.vec4)
         {
             Vec4 *vec4 = getPrivateData<Vec4>(value);
-            gl.Uniform4f(it->second, vec4->x, vec4->y, vec4->z, vec4->w);
+            shader->setVec4(arg.location, *vec4);
         }
-        else IS_A("Bitmap")
+        else IS_A(classes.bitmap)
         {
-            VALUE unitObj = rb_hash_fetch(texUnits, rb_str_new_cstr(it->first));
+            VALUE unitObj = rb_hash_fetch(texUnits, arg.key);
 
             if (unitObj == Qnil)
-                rb_raise(rb_eIndexError, "No such texture unit: %s, please supply this when creating the shader", it->first);
+                rb_raise(rb_eIndexError, "No such texture unit: %s, please supply this when creating the shader", name);
 
             unsigned unitNum = NUM2UINT(unitObj);
             Bitmap *bitmap = getPrivateData<Bitmap>(value);
@@ -273,12 +377,12 @@ void CustomShader::applyArgs()
 
             gl.ActiveTexture(texUnit);
             gl.BindTexture(GL_TEXTURE_2D, bitmap->getGLTypes().tex.gl);
-            gl.Uniform1i(it->second, unitNum);
+            shader->setInteger(arg.location, unitNum);
             gl.ActiveTexture(GL_TEXTURE0);
         }
         else
         {
-            rb_raise(rb_eArgError, "Argument %s is of type %s, which is not a supported type", it->first, rb_obj_classname(value));
+            rb_raise(rb_eArgError, "Argument %s is of type %s, which is not a supported type", name, rb_obj_classname(value));
         }
     }
 }
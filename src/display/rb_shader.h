@@ -5,18 +5,40 @@
 #include "gl-util.h"
 #include "binding-util.h"
 #include "shader.h"
-#include <map>
+#include <string>
+#include <vector>
 
 class CompiledShader : public ShaderBase
 {
 public:
+    /* An argument uniform, resolved once at compile time.
+     * 'key' is the frozen name string used to look up its
+     * value; the caller keeps it alive */
+    struct Arg
+    {
+        std::string name;
+        VALUE key;
+        GLint location;
+    };
+
+    /* 'args' is an array of frozen name strings */
     CompiledShader(const char *contents, VALUE args);
     CompiledShader(const char *contents, VALUE args, const char *vertContents);
 
     const char *getContents();
     const char *getVertContents();
     GLuint getProgram();
-    std::map<const char *, GLint> getArgs();
+    const std::vector<Arg> &getArgs() const;
+
+    /* Queries the location of 'name' on first use only */
+    GLint uniformLocation(const char *name);
+
+    /* Skip uploads of values the program already holds */
+    void setFloat(GLint location, float value);
+    void setInteger(GLint location, int value);
+    void setVec2(GLint location, const Vec2 &value);
+    void setVec4(GLint location, const Vec4 &value);
+    void setMatrix4(GLint location, const float value[16]);
 
 private:
     void setupShaderSource(const char *contents, GLuint shader, bool vert);
@@ -25,7 +47,8 @@ private:
 
     const char *contents;
     const char *vertContents;
-    std::map<const char *, GLint> args;
+    std::vector<Arg> args;
+    std::vector<std::pair<std::string, GLint> > locations;
 };
 class CustomShader
 {
@@ -49,4 +72,15 @@ private:
     unsigned int phase;
 };
 
+/* Number of shaders in a scene element's shader array. The render
+ * thread must not touch Ruby objects and always gets 0; frames that
+ * use any are presented on the script thread instead */
+inline long shaderArrayLength(VALUE shaderArr)
+{
+    if (!shaderArr || shState->graphics().onRenderThread())
+        return 0;
+
+    return rb_array_len(shaderArr);
+}
+
 #endif
\ No newline at end of file
@@ -33,6 +33,7 @@
 #include "shader.h"
 #include "glstate.h"
 #include "quadarray.h"
+#include "spritebatch.h"
 
 #include "binding-util.h"
 
@@ -40,6 +41,8 @@
 #include "binding-types.h"
 
 #include <math.h>
+#include <float.h>
+#include <algorithm>
 #ifndef M_PI
 # define M_PI 3.14159265358979323846
 #endif
@@ -186,6 +189,52 @@ struct SpritePrivate
         wave.dirty = true;
     }
 
+    /* Mega bitmaps live in several textures, so the source
+     * rectangle is drawn tile by tile, each tile covering its
+     * own slice of the sprite */
+    void drawMegaTiles(ShaderBase &base, bool renderEffect)
+    {
+        IntRect src(srcRect->x, srcRect->y, srcRect->width, srcRect->height);
+        src.w = clamp<int>(src.w, 0, bitmap->width()-src.x);
+        src.h = clamp<int>(src.h, 0, bitmap->height()-src.y);
+        
+        /* Bush depth is normalized over the whole bitmap */
+        float bushY = efBushDepth * bitmap->height();
+        Quad &quad = shState->gpQuad();
+        
+        for (int i = 0; i < bitmap->megaTileCount(); ++i)
+        {
+            IntRect tile = bitmap->megaTileRect(i);
+            IntRect part;
+            
+            if (!SDL_IntersectRect(&src, &tile, &part))
+                continue;
+            
+            FloatRect tex(part.x - tile.x, part.y - tile.y, part.w, part.h);
+            FloatRect pos(part.x - src.x, part.y - src.y, part.w, part.h);
+            
+            if (mirrored)
+            {
+                tex = tex.hFlipped();
+                pos.x = src.w - (pos.x + pos.w);
+            }
+            else if (vMirrored)
+            {
+                tex = tex.vFlipped();
+                pos.y = src.h - (pos.y + pos.h);
+            }
+            
+            bitmap->bindMegaTile(i, base);
+            TEX::setSmooth(true);
+            
+            if (renderEffect)
+                static_cast<SpriteShader&>(base).setBushDepth((bushY - tile.y) / tile.h);
+            
+            quad.setTexPosRect(tex, pos);
+            quad.draw();
+        }
+    }
+
     CompiledShader* bindCustomShader(long i, int width, int height)
     {
         VALUE value = rb_ary_entry(shaderArr, i);
@@ -415,8 +464,6 @@ void Sprite::setBitmap(Bitmap *bitmap)
     if (nullOrDisposed(bitmap))
         return;
     
-    bitmap->ensureNonMega();
-    
     *p->srcRect = bitmap->rect();
     p->onSrcRectChange();
     p->quad.setPosRect(p->srcRect->toFloatRect());
@@ -700,12 +747,25 @@ void Sprite::draw()
         base = &shader;
     }
     
-    p->bitmap->bindTex(*base);
+    /* Custom shader stacks and wave need a single source
+     * texture, which mega bitmaps don't have */
+    if (p->bitmap->isMega())
+    {
+        glState.blendMode.pushSet(p->blendType);
+        p->drawMegaTiles(*base, renderEffect);
+        glState.blendMode.pop();
+        return;
+    }
+    
+    /* SpriteShader normalizes texture coordinates by the texture
+     * size (bush depth, pattern scroll), so it needs the frame or
+     * atlas entry on its own rather than sampled from its page */
+    p->bitmap->bindTex(*base, renderEffect);
     glState.blendMode.pushSet(p->blendType);
 
     if(p->shaderArr)
     {
-        long size = rb_array_len(p->shaderArr);
+        long size = shaderArrayLength(p->shaderArr);
         if(size > 0)
         {
             // Store the current FBO used, as FBO::unbind() will set it to 0 which is not correct
@@ -766,6 +826,93 @@ void Sprite::draw()
     glState.blendMode.pop();
 }
 
+bool Sprite::batchDraw(SpriteBatch &batch)
+{
+    if (!p->isVisible)
+        return true;
+    
+    if (emptyFlashFlag)
+        return true;
+    
+    /* Effects that need more than a textured quad, or
+     * a texture of their own */
+    if (p->wave.active              ||
+        p->bushDepth != 0           ||
+        p->invert                   ||
+        (p->pattern && !p->pattern->isDisposed()) ||
+        p->bitmap->isMega())
+        return false;
+    
+    if (shaderArrayLength(p->shaderArr) > 0)
+        return false;
+    
+    /* When both flashing and effective color are set,
+     * the one with higher alpha will be blended */
+    const Vec4 &blend = (flashing && flashColor.w > p->color->norm.w) ?
+    flashColor : p->color->norm;
+    
+    Vec2i offset;
+    const TEXFBO &tex = p->bitmap->sampleSource(offset);
+    
+    batch.add(tex, offset, p->blendType, p->quad.vert, p->trans.getMatrix(),
+              blend, p->tone->norm, p->opacity.norm);
+    
+    return true;
+}
+
+bool Sprite::hasCustomShaders()
+{
+    return p->shaderArr && rb_array_len(p->shaderArr) > 0;
+}
+
+bool Sprite::bounds(IntRect &rect)
+{
+    if (nullOrDisposed(p->bitmap))
+        return false;
+    
+    float x1 = FLT_MAX, y1 = FLT_MAX;
+    float x2 = -FLT_MAX, y2 = -FLT_MAX;
+    
+    for (int i = 0; i < 4; ++i)
+    {
+        const Vec2 &pos = p->quad.vert[i].pos;
+        x1 = std::min(x1, pos.x); x2 = std::max(x2, pos.x);
+        y1 = std::min(y1, pos.y); y2 = std::max(y2, pos.y);
+    }
+    
+    /* Wave chunks are shifted horizontally by up to 'amp' */
+    if (p->wave.active)
+    {
+        x1 -= fabs(p->wave.amp);
+        x2 += fabs(p->wave.amp);
+    }
+    
+    const float *m = p->trans.getMatrix();
+    const Vec2 corners[] =
+    {
+        Vec2(x1, y1), Vec2(x2, y1), Vec2(x2, y2), Vec2(x1, y2)
+    };
+    
+    float bx1 = FLT_MAX, by1 = FLT_MAX;
+    float bx2 = -FLT_MAX, by2 = -FLT_MAX;
+    
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = m[0] * corners[i].x + m[4] * corners[i].y + m[12];
+        float y = m[1] * corners[i].x + m[5] * corners[i].y + m[13];
+        
+        bx1 = std::min(bx1, x); bx2 = std::max(bx2, x);
+        by1 = std::min(by1, y); by2 = std::max(by2, y);
+    }
+    
+    rect.x = floorf(bx1);
+    rect.y = floorf(by1);
+    rect.w = (int) ceilf(bx2) - rect.x;
+    rect.h = (int) ceilf(by2) - rect.y;
+    
+    return true;
+}
+
 void Sprite::onGeometryChange(const Scene::Geometry &geo)
 {
     /* Offset at which the sprite will be drawn
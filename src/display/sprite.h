@@ -87,6 +87,9 @@ private:
 	SpritePrivate *p;
 
 	void draw();
+	bool batchDraw(SpriteBatch &batch);
+	bool bounds(IntRect &rect);
+	bool hasCustomShaders();
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
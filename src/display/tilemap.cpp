@@ -38,6 +38,7 @@
 #include "vertex.h"
 #include "tileatlas.h"
 #include "tilemap-common.h"
+#include "profiler.h"
 
 #include "sigslot/signal.hpp"
 
@@ -228,6 +229,10 @@ struct ZLayer : public ViewportElement
 	void initUpdateZ();
 	void finiUpdateZ(ZLayer *prev);
 
+	/* The scene sorts lazily when compositing, which
+	 * happens after the batches are worked out */
+	void sortScene();
+
 	ABOUT_TO_ACCESS_NOOP
 };
 
@@ -447,7 +452,7 @@ struct TilemapPrivate
 
 		for (int i = 0; i < autotileCount; ++i)
 		{
-			if (nullOrDisposed(autotiles[i]) || autotiles[i]->megaSurface())
+			if (nullOrDisposed(autotiles[i]) || autotiles[i]->isMega())
 			{
 				atlas.nATFrames[i] = 1;
 				continue;
@@ -536,6 +541,12 @@ struct TilemapPrivate
 		glState.scissorTest.pop();
 		glState.clearColor.pop();
 
+		/* Queued drawing must not land mid-blit */
+		for (size_t i = 0; i < atlas.usableATs.size(); ++i)
+			autotiles[atlas.usableATs[i]]->flushDeferred();
+
+		tileset->flushDeferred();
+
 		GLMeta::blitBegin(atlas.gl);
 
 		/* Blit autotiles */
@@ -550,7 +561,7 @@ struct TilemapPrivate
 			int blitW = std::min(atW, atAreaW);
 			int blitH = std::min(atH, autotileH);
 
-			GLMeta::blitSource(autotile->getGLTypes());
+			GLMeta::blitSource(autotile->getGLTypesUnflushed());
 
 			if (atW <= autotileW && tiles.animated && !atlas.smallATs[atInd])
 			{
@@ -580,68 +591,43 @@ struct TilemapPrivate
 		GLMeta::blitEnd();
 
 		/* Blit tileset */
-		if (tileset->megaSurface())
+		if (tileset->isMega())
 		{
-			/* Mega surface tileset */
-			SDL_Surface *tsSurf = tileset->megaSurface();
+			/* Mega surface tileset; lanes may straddle the
+			 * borders of its tiles, so each one is blitted
+			 * piecewise from every tile it overlaps */
+			GLMeta::blitBegin(atlas.gl);
 
-			if (shState->config().subImageFix)
+			for (int t = 0; t < tileset->megaTileCount(); ++t)
 			{
-				/* Implementation for broken GL drivers */
-				FBO::bind(atlas.gl.fbo);
-				glState.blend.pushSet(false);
-				glState.viewport.pushSet(IntRect(0, 0, atlas.size.x, atlas.size.y));
-
-				SimpleShader &shader = shState->shaders().simple;
-				shader.bind();
-				shader.applyViewportProj();
-				shader.setTranslation(Vec2i());
-
-				Quad &quad = shState->gpQuad();
+				const IntRect tileRect = tileset->megaTileRect(t);
+				GLMeta::blitSource(tileset->megaTile(t));
 
 				for (size_t i = 0; i < blits.size(); ++i)
 				{
 					const TileAtlas::Blit &blitOp = blits[i];
 
-					Vec2i texSize;
-					shState->ensureTexSize(tsLaneW, blitOp.h, texSize);
-					shState->bindTex();
-					GLMeta::subRectImageUpload(tsSurf->w, blitOp.src.x, blitOp.src.y,
-					                           0, 0, tsLaneW, blitOp.h, tsSurf, GL_RGBA);
-
-					shader.setTexSize(texSize);
-					quad.setTexRect(FloatRect(0, 0, tsLaneW, blitOp.h));
-					quad.setPosRect(FloatRect(blitOp.dst.x, blitOp.dst.y, tsLaneW, blitOp.h));
-
-					quad.draw();
-				}
-
-				GLMeta::subRectImageEnd();
-				glState.viewport.pop();
-				glState.blend.pop();
-			}
-			else
-			{
-				/* Clean implementation */
-				TEX::bind(atlas.gl.tex);
+					int x1 = std::max(blitOp.src.x, tileRect.x);
+					int y1 = std::max(blitOp.src.y, tileRect.y);
+					int x2 = std::min(blitOp.src.x + tsLaneW, tileRect.x + tileRect.w);
+					int y2 = std::min(blitOp.src.y + blitOp.h, tileRect.y + tileRect.h);
 
-				for (size_t i = 0; i < blits.size(); ++i)
-				{
-					const TileAtlas::Blit &blitOp = blits[i];
+					if (x1 >= x2 || y1 >= y2)
+						continue;
 
-					GLMeta::subRectImageUpload(tsSurf->w, blitOp.src.x, blitOp.src.y,
-					                           blitOp.dst.x, blitOp.dst.y, tsLaneW, blitOp.h, tsSurf, GL_RGBA);
+					GLMeta::blitRectangle(IntRect(x1 - tileRect.x, y1 - tileRect.y, x2 - x1, y2 - y1),
+					                      Vec2i(blitOp.dst.x + x1 - blitOp.src.x,
+					                            blitOp.dst.y + y1 - blitOp.src.y));
 				}
-
-				GLMeta::subRectImageEnd();
 			}
 
+			GLMeta::blitEnd();
 		}
 		else
 		{
 			/* Regular tileset */
 			GLMeta::blitBegin(atlas.gl);
-			GLMeta::blitSource(tileset->getGLTypes());
+			GLMeta::blitSource(tileset->getGLTypesUnflushed());
 
 			for (size_t i = 0; i < blits.size(); ++i)
 			{
@@ -866,7 +852,7 @@ struct TilemapPrivate
 		}
 		else
 		{
-			shaderVar = &shState->shaders().simple;
+			shaderVar = &shState->shaders().simple.get();
 			shaderVar->bind();
 		}
 
@@ -953,6 +939,11 @@ struct TilemapPrivate
 	{
 		ZLayer *const *zlayers = elem.zlayers;
 
+		/* Batches are found by walking the scene list,
+		 * which has to be in draw order for that */
+		if (elem.activeLayers > 0)
+			zlayers[0]->sortScene();
+
 		for (size_t i = 0; i < elem.activeLayers; ++i)
 		{
 			ZLayer *batchHead = zlayers[i];
@@ -998,6 +989,8 @@ struct TilemapPrivate
 
 	void prepare()
 	{
+		PROFILE_ZONE("Tilemap::prepare");
+
 		if (!verifyResources())
 		{
 			if (tilemapReady)
@@ -1164,6 +1157,11 @@ void ZLayer::finiUpdateZ(ZLayer *prev)
 		scene->insert(*this);
 }
 
+void ZLayer::sortScene()
+{
+	scene->sortElements();
+}
+
 void Tilemap::Autotiles::set(int i, Bitmap *bitmap)
 {
 	if (!p)
@@ -34,6 +34,7 @@
 #include "quadarray.h"
 #include "shader.h"
 #include "tilemap-common.h"
+#include "profiler.h"
 
 #include <vector>
 #include "sigslot/signal.hpp"
@@ -247,6 +248,8 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		if (!mapData)
 			return;
 
+		PROFILE_ZONE("TilemapVX::prepare");
+
 		if (atlasDirty)
 		{
 			rebuildAtlas();
@@ -302,7 +305,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		else
 		{
 			/* Static tileset */
-			shader = &shState->shaders().simple;
+			shader = &shState->shaders().simple.get();
 			shader->bind();
 		}
 
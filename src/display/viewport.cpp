@@ -28,6 +28,8 @@
 #include "glstate.h"
 #include "graphics.h"
 #include "binding-util.h"
+#include "rb_shader.h"
+#include "profiler.h"
 #include "debugwriter.h"
 
 #include <SDL_rect.h>
@@ -97,10 +99,8 @@ struct ViewportPrivate
 
 	bool needsEffectRender(bool flashing)
 	{
-		if (shaderArr) {
-			if (rb_array_len(shaderArr) > 0) {
-				return true;
-			}
+		if (shaderArrayLength(shaderArr) > 0) {
+			return true;
 		}
 
 		bool rectEffective = !rect->isEmpty();
@@ -205,6 +205,8 @@ void Viewport::composite()
 	if (elements.getSize() == 0 && !renderEffect)
 		return;
 
+	PROFILE_ZONE("Viewport::composite");
+
 	/* Setup scissor */
 	glState.scissorTest.pushSet(true);
 	glState.scissorBox.pushSet(p->rect->toIntRect());
@@ -227,6 +229,20 @@ void Viewport::draw()
 	composite();
 }
 
+bool Viewport::bounds(IntRect &rect)
+{
+	rect = p->rect->toIntRect();
+	return true;
+}
+
+bool Viewport::hasCustomShaders()
+{
+	if (p->shaderArr && rb_array_len(p->shaderArr) > 0)
+		return true;
+
+	return containsCustomShaders();
+}
+
 void Viewport::onGeometryChange(const Geometry &geo)
 {
 	p->screenRect = geo.rect;
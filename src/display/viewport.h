@@ -55,6 +55,8 @@ private:
 
 	void composite();
 	void draw();
+	bool bounds(IntRect &rect);
+	bool hasCustomShaders();
 	void onGeometryChange(const Geometry &);
 	bool isEffectiveViewport(Rect *&, Color *&, Tone *&) const;
 
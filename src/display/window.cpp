@@ -33,6 +33,7 @@
 #include "quadarray.h"
 #include "texpool.h"
 #include "glstate.h"
+#include "profiler.h"
 
 #include "sigslot/signal.hpp"
 
@@ -220,6 +221,12 @@ struct WindowPrivate
 			p->drawControls();
 		}
 
+		bool bounds(IntRect &rect)
+		{
+			rect = IntRect(p->position + p->sceneOffset, p->size);
+			return true;
+		}
+
 		void release()
 		{
 			unlink();
@@ -513,6 +520,8 @@ struct WindowPrivate
 		if (size.x <= 0 || size.y <= 0)
 			return;
 
+		PROFILE_ZONE("Window::prepare");
+
 		bool updateBaseQuadArray = false;
 
 		if (baseVertDirty)
@@ -867,6 +876,12 @@ void Window::draw()
 	p->drawBase();
 }
 
+bool Window::bounds(IntRect &rect)
+{
+	rect = IntRect(p->position + p->sceneOffset, p->size);
+	return true;
+}
+
 void Window::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset = geo.offset();
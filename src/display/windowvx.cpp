@@ -31,6 +31,7 @@
 #include "tilequad.h"
 #include "glstate.h"
 #include "shader.h"
+#include "profiler.h"
 
 #include <limits>
 #include <algorithm>
@@ -439,7 +440,7 @@ struct WindowVXPrivate
 		}
 		else
 		{
-			shader = &shState->shaders().simple;
+			shader = &shState->shaders().simple.get();
 			shader->bind();
 		}
 
@@ -461,9 +462,9 @@ struct WindowVXPrivate
 		glState.blendMode.set(BlendNormal);
 
 		/* If we used plane shader before, switch to simple */
-		if (shader != &shState->shaders().simple)
+		if (shader != &shState->shaders().simple.get())
 		{
-			shader = &shState->shaders().simple;
+			shader = &shState->shaders().simple.get();
 			shader->bind();
 			shader->setTranslation(Vec2i());
 			shader->applyViewportProj();
@@ -669,6 +670,8 @@ struct WindowVXPrivate
 
 	void prepare()
 	{
+		PROFILE_ZONE("WindowVX::prepare");
+
 		if (base.vertDirty)
 		{
 			rebuildBaseVert();
@@ -1101,6 +1104,12 @@ void WindowVX::draw()
 	p->draw();
 }
 
+bool WindowVX::bounds(IntRect &rect)
+{
+	rect = IntRect(p->geo.pos() + p->sceneOffset, p->geo.size());
+	return true;
+}
+
 void WindowVX::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset = geo.offset();
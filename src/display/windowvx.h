@@ -72,6 +72,7 @@ private:
 	WindowVXPrivate *p;
 
 	void draw();
+	bool bounds(IntRect &rect);
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
@@ -46,6 +46,7 @@
 
 #include "al-util.h"
 #include "debugwriter.h"
+#include "profiler.h"
 
 #ifndef __APPLE__
 #include "util/string-util.h"
@@ -205,6 +206,8 @@ void EventThread::process(RGSSThreadData &rtData)
     
     textInputBuffer.clear();
     
+    PROFILE_THREAD("Events");
+    
     while (true)
     {
         if (!SDL_WaitEvent(&event))
@@ -213,6 +216,8 @@ void EventThread::process(RGSSThreadData &rtData)
             break;
         }
         
+        PROFILE_ZONE("EventThread::process");
+        
         /* Preselect and discard unwanted events here */
         switch (event.type)
         {
@@ -498,6 +503,15 @@ void EventThread::process(RGSSThreadData &rtData)
                         
                     case REQUEST_MESSAGEBOX :
                     {
+                        /* Nobody would be there to dismiss it */
+                        if (rtData.config.headless.enabled)
+                        {
+                            Debug() << (const char*) event.user.data1;
+                            free(event.user.data1);
+                            msgBoxDone.set();
+                            break;
+                        }
+                        
 #ifndef __APPLE__
                         // Try to format the message with additional newlines
                         std::string message = copyWithNewlines((const char*) event.user.data1,
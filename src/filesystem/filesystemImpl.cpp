@@ -57,6 +57,14 @@ bool filesystemImpl::setCurrentDirectory(const char *path) {
     return ret;
 }
 
+// Succeeds if the directory already exists
+bool filesystemImpl::createDirectory(const char *path) {
+    fs::path stdPath(path);
+    std::error_code ec;
+    fs::create_directories(stdPath, ec);
+    return fs::is_directory(stdPath, ec);
+}
+
 std::string filesystemImpl::getCurrentDirectory() {
     std::string ret;
     try {
@@ -17,6 +17,8 @@ bool fileExists(const char *path);
 std::string contentsOfFileAsString(const char *path);
 
 bool setCurrentDirectory(const char *path);
+
+bool createDirectory(const char *path);
     
 std::string getCurrentDirectory();
     
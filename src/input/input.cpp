@@ -24,6 +24,8 @@
 #include "sharedstate.h"
 #include "eventthread.h"
 #include "input/keybindings.h"
+#include "input/inputrecorder.h"
+#include "util/debugwriter.h"
 #include "util/exception.h"
 #include "util/util.h"
 
@@ -495,7 +497,7 @@ struct Binding
     : target(target)
     {}
     
-    virtual bool sourceActive() const = 0;
+    virtual bool sourceActive(const InputFrame &frame) const = 0;
     virtual bool sourceRepeatable() const = 0;
     
     Input::ButtonCode target;
@@ -511,18 +513,18 @@ struct KbBinding : public Binding
     source(data.source)
     {}
     
-    bool sourceActive() const
+    bool sourceActive(const InputFrame &frame) const
     {
         /* Special case aliases */
         if (source == SDL_SCANCODE_LSHIFT)
-            return EventThread::keyStates[source]
-            || EventThread::keyStates[SDL_SCANCODE_RSHIFT];
+            return frame.keys[source]
+            || frame.keys[SDL_SCANCODE_RSHIFT];
         
         if (source == SDL_SCANCODE_RETURN)
-            return EventThread::keyStates[source]
-            || EventThread::keyStates[SDL_SCANCODE_KP_ENTER];
+            return frame.keys[source]
+            || frame.keys[SDL_SCANCODE_KP_ENTER];
         
-        return EventThread::keyStates[source];
+        return frame.keys[source];
     }
     
     bool sourceRepeatable() const
@@ -542,9 +544,9 @@ struct CtrlButtonBinding : public Binding
 {
     CtrlButtonBinding() {}
     
-    bool sourceActive() const
+    bool sourceActive(const InputFrame &frame) const
     {
-        return EventThread::controllerState.buttons[source];
+        return frame.ctrlButtons[source];
     }
     
     bool sourceRepeatable() const
@@ -562,9 +564,9 @@ struct CtrlAxisBinding : public Binding
     CtrlAxisBinding(uint8_t source, AxisDir dir, Input::ButtonCode target)
     : Binding(target), source(source), dir(dir) {}
     
-    bool sourceActive() const
+    bool sourceActive(const InputFrame &frame) const
     {
-        float val = EventThread::controllerState.axes[source];
+        float val = frame.ctrlAxes[source];
         
         if (dir == Negative)
             return val < -JAXIS_THRESHOLD;
@@ -591,9 +593,9 @@ struct MsBinding : public Binding
     index(buttonIndex)
     {}
     
-    bool sourceActive() const
+    bool sourceActive(const InputFrame &frame) const
     {
-        return EventThread::mouseState.buttons[index];
+        return frame.mouseButtons[index];
     }
     
     bool sourceRepeatable() const
@@ -716,6 +718,16 @@ struct InputPrivate
 
     int vScrollDistance;
     
+    /* Input of the current frame, taken from the event
+     * thread or from a replay */
+    InputRecorder recorder;
+    InputFrame frame;
+    bool replayDone;
+    
+    /* Accumulated until the script picks them up */
+    int pendingScroll;
+    std::string text;
+    
     struct
     {
         int active;
@@ -746,6 +758,7 @@ struct InputPrivate
     }
     
     InputPrivate(const RGSSThreadData &rtData)
+    : recorder(rtData.config)
     {
         last_update = 0;
         
@@ -782,6 +795,9 @@ struct InputPrivate
         dir8Data.active = 0;
         
         vScrollDistance = 0;
+        
+        replayDone = false;
+        pendingScroll = 0;
     }
     
     inline ButtonState &getStateCheck(int code)
@@ -1017,7 +1033,7 @@ struct InputPrivate
     void pollBindingPriv(const Binding &b,
                          Input::ButtonCode &repeatCand)
     {
-        if (!b.sourceActive())
+        if (!b.sourceActive(frame))
             return;
         
         if (b.target == Input::None)
@@ -1050,7 +1066,7 @@ struct InputPrivate
     void updateRaw()
     {
         
-        memcpy(rawStates, shState->eThread().keyStates, SDL_NUM_SCANCODES);
+        memcpy(rawStates, frame.keys, SDL_NUM_SCANCODES);
         
         for (int i = 0; i < SDL_NUM_SCANCODES; i++)
         {
@@ -1078,9 +1094,9 @@ struct InputPrivate
     void updateControllerRaw()
     {
         for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++)
-            axisStateArray[i] = shState->eThread().controllerState.axes[i];
+            axisStateArray[i] = frame.ctrlAxes[i];
         
-        memcpy(rawButtonStates, shState->eThread().controllerState.buttons, SDL_CONTROLLER_BUTTON_MAX);
+        memcpy(rawButtonStates, frame.ctrlButtons, SDL_CONTROLLER_BUTTON_MAX);
         
         for (int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; i++)
         {
@@ -1102,6 +1118,59 @@ struct InputPrivate
         buttonRepeating = -1;
     }
     
+    void captureFrame()
+    {
+        EventThread &ethread = shState->eThread();
+        
+        memcpy(frame.keys, EventThread::keyStates, sizeof(frame.keys));
+        memcpy(frame.ctrlButtons, EventThread::controllerState.buttons, sizeof(frame.ctrlButtons));
+        memcpy(frame.mouseButtons, EventThread::mouseState.buttons, sizeof(frame.mouseButtons));
+        
+        for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++)
+            frame.ctrlAxes[i] = EventThread::controllerState.axes[i];
+        
+        frame.mouseX = EventThread::mouseState.x;
+        frame.mouseY = EventThread::mouseState.y;
+        frame.mouseInWindow = EventThread::mouseState.inWindow;
+        frame.scroll = SDL_AtomicSet(&EventThread::verticalScrollDistance, 0);
+        
+        /* Text is only sampled per frame when it has to be
+         * recorded; otherwise scripts see it as it's typed */
+        frame.text.clear();
+        
+        if (recorder.mode() == InputRecorder::Record) {
+            ethread.lockText(true);
+            frame.text.swap(ethread.textInputBuffer);
+            ethread.lockText(false);
+        }
+    }
+    
+    void nextFrame()
+    {
+        if (recorder.mode() != InputRecorder::Replay) {
+            captureFrame();
+            recorder.write(frame);
+        } else if (!recorder.read(frame)) {
+            /* Let go of everything and quit, exactly
+             * after the last recorded frame */
+            frame.clear();
+            
+            if (!replayDone) {
+                Debug() << "Input replay ended after" << recorder.frames() << "frames";
+                shState->eThread().requestTerminate();
+                replayDone = true;
+            }
+        }
+        
+        pendingScroll += frame.scroll;
+        text += frame.text;
+    }
+    
+    bool ownsText() const
+    {
+        return recorder.mode() != InputRecorder::Off;
+    }
+    
     void updateDir4()
     {
         int dirFlag = 0;
@@ -1202,6 +1271,7 @@ void Input::update()
 {
     shState->checkShutdown();
     p->checkBindingChange(shState->rtData());
+    p->nextFrame();
     
     p->swapBuffers();
     p->clearBuffer();
@@ -1216,9 +1286,9 @@ void Input::update()
     p->updateControllerRaw();
     
     // Record mouse positions
-    p->mousePos[0] = shState->eThread().mouseState.x;
-    p->mousePos[1] = shState->eThread().mouseState.y;
-    p->mouseInWindow = shState->eThread().mouseState.inWindow;
+    p->mousePos[0] = p->frame.mouseX;
+    p->mousePos[1] = p->frame.mouseY;
+    p->mouseInWindow = p->frame.mouseInWindow;
     
     
     /* Check for new repeating key */
@@ -1255,7 +1325,8 @@ void Input::update()
     p->repeating = None;
     
     /* Fetch new cumulative scroll distance and reset counter */
-    p->vScrollDistance = SDL_AtomicSet(&EventThread::verticalScrollDistance, 0);
+    p->vScrollDistance = p->pendingScroll;
+    p->pendingScroll = 0;
     
     p->last_update = shState->runTime();
 }
@@ -1489,12 +1560,27 @@ void Input::setTextInputMode(bool mode)
 
 const char *Input::getText()
 {
+    if (p->ownsText())
+        return p->text.c_str();
+    
     return shState->eThread().textInputBuffer.c_str();
 }
 
 void Input::clearText()
 {
-    shState->eThread().textInputBuffer.clear();
+    if (p->ownsText())
+        p->text.clear();
+    else
+        shState->eThread().textInputBuffer.clear();
+}
+
+bool Input::rngSeed(unsigned int &seed)
+{
+    if (p->recorder.mode() == InputRecorder::Off)
+        return false;
+    
+    seed = p->recorder.seed();
+    return true;
 }
 
 char *Input::getClipboardText()
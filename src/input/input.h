@@ -110,6 +110,10 @@ public:
     const char *getText();
     void clearText();
     
+    /* Seed for Ruby's random number generator when
+     * recording or replaying input; false otherwise */
+    bool rngSeed(unsigned int &seed);
+    
     char *getClipboardText();
     void setClipboardText(char *text);
     
@@ -0,0 +1,398 @@
+/*
+** inputrecorder.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "inputrecorder.h"
+#include "config.h"
+#include "exception.h"
+#include "debugwriter.h"
+
+#include <SDL_endian.h>
+#include <SDL_timer.h>
+
+#include <string.h>
+#include <time.h>
+
+#define FORMAT_VER 1
+
+/* Offset of the frame count in the header,
+ * filled in once recording ends */
+#define FRAME_TOTAL_OFFSET 12
+#define FRAME_TOTAL_UNKNOWN 0xFFFFFFFF
+
+static const char fileMagic[4] = { 'M', 'K', 'I', 'R' };
+
+/* What changed in a frame; everything else
+ * is the same as in the previous one */
+enum FrameFlags
+{
+    FrameKeys    = 1 << 0,
+    FrameButtons = 1 << 1,
+    FrameAxes    = 1 << 2,
+    FrameMouse   = 1 << 3,
+    FrameScroll  = 1 << 4,
+    FrameText    = 1 << 5
+};
+
+static bool readU8(SDL_RWops *ops, uint8_t &value)
+{
+    return SDL_RWread(ops, &value, 1, 1) == 1;
+}
+
+static bool readLE16(SDL_RWops *ops, uint16_t &value)
+{
+    if (SDL_RWread(ops, &value, sizeof(value), 1) != 1)
+        return false;
+
+    value = SDL_SwapLE16(value);
+    return true;
+}
+
+static bool readLE32(SDL_RWops *ops, uint32_t &value)
+{
+    if (SDL_RWread(ops, &value, sizeof(value), 1) != 1)
+        return false;
+
+    value = SDL_SwapLE32(value);
+    return true;
+}
+
+InputFrame::InputFrame()
+{
+    clear();
+}
+
+void InputFrame::clear()
+{
+    memset(keys, 0, sizeof(keys));
+    memset(ctrlButtons, 0, sizeof(ctrlButtons));
+    memset(ctrlAxes, 0, sizeof(ctrlAxes));
+    memset(mouseButtons, 0, sizeof(mouseButtons));
+
+    mouseX = mouseY = 0;
+    mouseInWindow = false;
+    scroll = 0;
+    text.clear();
+}
+
+InputRecorder::InputRecorder(const Config &conf)
+    : currentMode(Off),
+      ops(0),
+      rngSeed(0),
+      frameTotal(0),
+      frameIndex(0)
+{
+    if (!conf.inputReplay.empty())
+    {
+        if (!conf.inputRecord.empty())
+            Debug() << "Both inputRecord and inputReplay are set; only replaying";
+
+        open(conf.inputReplay, Replay);
+    }
+    else if (!conf.inputRecord.empty())
+    {
+        open(conf.inputRecord, Record);
+    }
+}
+
+InputRecorder::~InputRecorder()
+{
+    if (!ops)
+        return;
+
+    if (currentMode == Record)
+    {
+        SDL_RWseek(ops, FRAME_TOTAL_OFFSET, RW_SEEK_SET);
+        SDL_WriteLE32(ops, frameIndex);
+    }
+
+    SDL_RWclose(ops);
+}
+
+void InputRecorder::open(const std::string &path, Mode mode)
+{
+    ops = SDL_RWFromFile(path.c_str(), mode == Record ? "wb" : "rb");
+
+    if (!ops)
+        throw Exception(Exception::MKXPError, "Failed to open input %s file %s: %s",
+                        mode == Record ? "recording" : "replay", path.c_str(), SDL_GetError());
+
+    currentMode = mode;
+
+    if (mode == Record)
+    {
+        rngSeed = (uint32_t) (SDL_GetPerformanceCounter() ^ time(0));
+
+        SDL_RWwrite(ops, fileMagic, sizeof(fileMagic), 1);
+        SDL_WriteLE32(ops, FORMAT_VER);
+        SDL_WriteLE32(ops, rngSeed);
+        SDL_WriteLE32(ops, FRAME_TOTAL_UNKNOWN);
+        SDL_WriteLE16(ops, SDL_NUM_SCANCODES);
+        SDL_WriteU8(ops, SDL_CONTROLLER_BUTTON_MAX);
+        SDL_WriteU8(ops, SDL_CONTROLLER_AXIS_MAX);
+        SDL_WriteU8(ops, INPUT_MOUSE_BUTTONS);
+
+        Debug() << "Recording input to" << path;
+
+        return;
+    }
+
+    char magic[sizeof(fileMagic)];
+    uint32_t version;
+    uint16_t scancodes;
+    uint8_t buttons, axes, mouseButtons;
+
+    /* Sizes differing means the file is from
+     * a build with a different SDL */
+    bool valid = SDL_RWread(ops, magic, sizeof(magic), 1) == 1 &&
+                 !memcmp(magic, fileMagic, sizeof(magic)) &&
+                 readLE32(ops, version) && version == FORMAT_VER &&
+                 readLE32(ops, rngSeed) &&
+                 readLE32(ops, frameTotal) &&
+                 readLE16(ops, scancodes) && scancodes == SDL_NUM_SCANCODES &&
+                 readU8(ops, buttons) && buttons == SDL_CONTROLLER_BUTTON_MAX &&
+                 readU8(ops, axes) && axes == SDL_CONTROLLER_AXIS_MAX &&
+                 readU8(ops, mouseButtons) && mouseButtons == INPUT_MOUSE_BUTTONS;
+
+    if (!valid)
+    {
+        SDL_RWclose(ops);
+        ops = 0;
+        currentMode = Off;
+
+        throw Exception(Exception::MKXPError, "%s is not a compatible input recording", path.c_str());
+    }
+
+    if (frameTotal == FRAME_TOTAL_UNKNOWN)
+        Debug() << "Replaying input from" << path << "(unfinished recording)";
+    else
+        Debug() << "Replaying" << frameTotal << "frames of input from" << path;
+}
+
+void InputRecorder::write(const InputFrame &frame)
+{
+    if (currentMode != Record)
+        return;
+
+    uint16_t keys[SDL_NUM_SCANCODES];
+    uint8_t buttons[SDL_CONTROLLER_BUTTON_MAX];
+    uint8_t axes[SDL_CONTROLLER_AXIS_MAX];
+    int keyCount = 0, buttonCount = 0, axisCount = 0;
+
+    /* Keys and buttons are stored as toggles */
+    for (int i = 0; i < SDL_NUM_SCANCODES; ++i)
+        if (!frame.keys[i] != !last.keys[i])
+            keys[keyCount++] = i;
+
+    for (int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; ++i)
+        if (frame.ctrlButtons[i] != last.ctrlButtons[i])
+            buttons[buttonCount++] = i;
+
+    for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; ++i)
+        if (frame.ctrlAxes[i] != last.ctrlAxes[i])
+            axes[axisCount++] = i;
+
+    bool mouseChanged = frame.mouseX != last.mouseX ||
+                        frame.mouseY != last.mouseY ||
+                        frame.mouseInWindow != last.mouseInWindow ||
+                        memcmp(frame.mouseButtons, last.mouseButtons, sizeof(frame.mouseButtons));
+
+    uint8_t flags = 0;
+
+    if (keyCount > 0)
+        flags |= FrameKeys;
+    if (buttonCount > 0)
+        flags |= FrameButtons;
+    if (axisCount > 0)
+        flags |= FrameAxes;
+    if (mouseChanged)
+        flags |= FrameMouse;
+    if (frame.scroll != 0)
+        flags |= FrameScroll;
+    if (!frame.text.empty())
+        flags |= FrameText;
+
+    SDL_WriteU8(ops, flags);
+
+    if (flags & FrameKeys)
+    {
+        SDL_WriteLE16(ops, keyCount);
+
+        for (int i = 0; i < keyCount; ++i)
+            SDL_WriteLE16(ops, keys[i]);
+    }
+
+    if (flags & FrameButtons)
+    {
+        SDL_WriteU8(ops, buttonCount);
+        SDL_RWwrite(ops, buttons, 1, buttonCount);
+    }
+
+    if (flags & FrameAxes)
+    {
+        SDL_WriteU8(ops, axisCount);
+
+        for (int i = 0; i < axisCount; ++i)
+        {
+            SDL_WriteU8(ops, axes[i]);
+            SDL_WriteLE16(ops, (uint16_t) frame.ctrlAxes[axes[i]]);
+        }
+    }
+
+    if (flags & FrameMouse)
+    {
+        uint32_t mouseButtons = 0;
+
+        for (int i = 0; i < INPUT_MOUSE_BUTTONS; ++i)
+            mouseButtons |= frame.mouseButtons[i] ? (1u << i) : 0;
+
+        SDL_WriteLE32(ops, (uint32_t) frame.mouseX);
+        SDL_WriteLE32(ops, (uint32_t) frame.mouseY);
+        SDL_WriteLE32(ops, mouseButtons);
+        SDL_WriteU8(ops, frame.mouseInWindow);
+    }
+
+    if (flags & FrameScroll)
+        SDL_WriteLE32(ops, (uint32_t) frame.scroll);
+
+    if (flags & FrameText)
+    {
+        uint16_t length = frame.text.size() > 0xFFFF ? 0xFFFF : frame.text.size();
+
+        SDL_WriteLE16(ops, length);
+        SDL_RWwrite(ops, frame.text.c_str(), 1, length);
+    }
+
+    last = frame;
+    ++frameIndex;
+}
+
+bool InputRecorder::read(InputFrame &frame)
+{
+    if (currentMode != Replay || (uint32_t) frameIndex >= frameTotal)
+        return false;
+
+    uint8_t flags;
+
+    /* Unfinished recordings simply end here */
+    if (!readU8(ops, flags))
+    {
+        frameTotal = frameIndex;
+        return false;
+    }
+
+    bool valid = true;
+
+    if (flags & FrameKeys)
+    {
+        uint16_t count = 0, key;
+        valid = readLE16(ops, count);
+
+        for (int i = 0; valid && i < count; ++i)
+        {
+            valid = readLE16(ops, key) && key < SDL_NUM_SCANCODES;
+
+            if (valid)
+                last.keys[key] = !last.keys[key];
+        }
+    }
+
+    if (valid && (flags & FrameButtons))
+    {
+        uint8_t count = 0, button;
+        valid = readU8(ops, count);
+
+        for (int i = 0; valid && i < count; ++i)
+        {
+            valid = readU8(ops, button) && button < SDL_CONTROLLER_BUTTON_MAX;
+
+            if (valid)
+                last.ctrlButtons[button] = !last.ctrlButtons[button];
+        }
+    }
+
+    if (valid && (flags & FrameAxes))
+    {
+        uint8_t count = 0, axis;
+        uint16_t value;
+        valid = readU8(ops, count);
+
+        for (int i = 0; valid && i < count; ++i)
+        {
+            valid = readU8(ops, axis) && axis < SDL_CONTROLLER_AXIS_MAX &&
+                    readLE16(ops, value);
+
+            if (valid)
+                last.ctrlAxes[axis] = (int16_t) value;
+        }
+    }
+
+    if (valid && (flags & FrameMouse))
+    {
+        uint32_t x, y, mouseButtons;
+        uint8_t inWindow;
+
+        valid = readLE32(ops, x) && readLE32(ops, y) &&
+                readLE32(ops, mouseButtons) && readU8(ops, inWindow);
+
+        if (valid)
+        {
+            last.mouseX = (int32_t) x;
+            last.mouseY = (int32_t) y;
+            last.mouseInWindow = inWindow;
+
+            for (int i = 0; i < INPUT_MOUSE_BUTTONS; ++i)
+                last.mouseButtons[i] = mouseButtons & (1u << i);
+        }
+    }
+
+    last.scroll = 0;
+    last.text.clear();
+
+    if (valid && (flags & FrameScroll))
+    {
+        uint32_t scroll;
+        valid = readLE32(ops, scroll);
+        last.scroll = (int32_t) scroll;
+    }
+
+    if (valid && (flags & FrameText))
+    {
+        uint16_t length;
+        valid = readLE16(ops, length);
+
+        if (valid && length > 0)
+        {
+            last.text.resize(length);
+            valid = SDL_RWread(ops, &last.text[0], length, 1) == 1;
+        }
+    }
+
+    if (!valid)
+    {
+        Debug() << "Input recording is cut off in frame" << frameIndex;
+        frameTotal = frameIndex;
+
+        return false;
+    }
+
+    frame = last;
+    ++frameIndex;
+
+    return true;
+}
@@ -0,0 +1,96 @@
+/*
+** inputrecorder.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPUTRECORDER_H
+#define INPUTRECORDER_H
+
+#include <SDL_scancode.h>
+#include <SDL_gamecontroller.h>
+#include <SDL_rwops.h>
+
+#include <stdint.h>
+#include <string>
+
+#define INPUT_MOUSE_BUTTONS 32
+
+struct Config;
+
+/* Everything Input::update reads in one frame */
+struct InputFrame
+{
+    uint8_t keys[SDL_NUM_SCANCODES];
+    bool ctrlButtons[SDL_CONTROLLER_BUTTON_MAX];
+    int ctrlAxes[SDL_CONTROLLER_AXIS_MAX];
+
+    int mouseX, mouseY;
+    bool mouseInWindow;
+    bool mouseButtons[INPUT_MOUSE_BUTTONS];
+
+    /* Scroll distance and text typed since the previous frame */
+    int scroll;
+    std::string text;
+
+    InputFrame();
+
+    void clear();
+};
+
+/* Logs the input of every frame to a file, or plays such
+ * a file back in place of live input ("inputRecord" and
+ * "inputReplay" in mkxp.json). Frames are stored as changes
+ * against the previous one, so idle frames take a single byte.
+ * The file also carries the seed for Ruby's random number
+ * generator, so a replay takes the same random branches */
+class InputRecorder
+{
+public:
+    enum Mode
+    {
+        Off,
+        Record,
+        Replay
+    };
+
+    InputRecorder(const Config &conf);
+    ~InputRecorder();
+
+    Mode mode() const { return currentMode; }
+    uint32_t seed() const { return rngSeed; }
+    int frames() const { return frameIndex; }
+
+    void write(const InputFrame &frame);
+
+    /* Returns false once every recorded frame was read */
+    bool read(InputFrame &frame);
+
+private:
+    void open(const std::string &path, Mode mode);
+
+    Mode currentMode;
+    SDL_RWops *ops;
+
+    uint32_t rngSeed;
+    uint32_t frameTotal;
+    int frameIndex;
+
+    /* Frame the next one is encoded against */
+    InputFrame last;
+};
+
+#endif // INPUTRECORDER_H
@@ -41,6 +41,7 @@
 #include "eventthread.h"
 #include "util/debugwriter.h"
 #include "util/exception.h"
+#include "util/profiler.h"
 #include "display/gl/gl-debug.h"
 #include "display/gl/gl-fun.h"
 
@@ -119,6 +120,8 @@ static SDL_GLContext initGL(SDL_Window *win, Config &conf,
 int rgssThreadFun(void *userdata) {
   RGSSThreadData *threadData = static_cast<RGSSThreadData *>(userdata);
 
+  PROFILE_THREAD("RGSS");
+
 #ifdef MKXPZ_INIT_GL_LATER
   threadData->glContext =
       initGL(threadData->window, threadData->config, threadData);
@@ -209,8 +212,9 @@ int main(int argc, char *argv[]) {
     SDL_SetHint(SDL_HINT_OPENGL_ES_DRIVER, "1");
 #endif
 
-    /* initialize SDL first */
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) < 0) {
+    /* initialize SDL first; video follows once the
+     * config says which driver to use */
+    if (SDL_Init(SDL_INIT_GAMECONTROLLER) < 0) {
       showInitError(std::string("Error initializing SDL: ") + SDL_GetError());
       return 0;
     }
@@ -239,6 +243,17 @@ int main(int argc, char *argv[]) {
     Config conf;
     conf.read(argc, argv);
 
+    /* Headless mode has to work without any display to
+     * connect to, so the default driver is never tried */
+    if (conf.headless.enabled)
+      SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0) {
+      showInitError(std::string("Error initializing SDL video: ") + SDL_GetError());
+      SDL_Quit();
+      return 0;
+    }
+
 #if defined(__WIN32__)
     // Create a debug console in debug mode
     if (conf.winConsole) {
@@ -325,6 +340,8 @@ int main(int argc, char *argv[]) {
       winFlags |= SDL_WINDOW_RESIZABLE;
     if (conf.fullscreen)
       winFlags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+    if (conf.headless.enabled)
+      winFlags = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN;
     
 #ifdef GLES2_HEADER
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
@@ -387,7 +404,8 @@ int main(int argc, char *argv[]) {
     /* OSX and Windows have their own native ways of
      * dealing with icons; don't interfere with them */
 #ifdef __LINUX__
-    setupWindowIcon(conf, win);
+    if (!conf.headless.enabled)
+      setupWindowIcon(conf, win);
 #else
     (void)setupWindowIcon;
 #endif
@@ -465,6 +483,8 @@ int main(int argc, char *argv[]) {
      * otherwise abandon hope and just end the process as is. */
     if (rtData.rqTermAck)
       SDL_WaitThread(rgssThread, 0);
+    else if (conf.headless.enabled)
+      Debug() << "The RGSS script seems to be stuck. Forcing quit.";
     else
       SDL_ShowSimpleMessageBox(
           SDL_MESSAGEBOX_ERROR, conf.game.title.c_str(),
@@ -473,10 +493,14 @@ int main(int argc, char *argv[]) {
 
     if (!rtData.rgssErrorMsg.empty()) {
       Debug() << rtData.rgssErrorMsg;
-      SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, conf.game.title.c_str(),
-                               rtData.rgssErrorMsg.c_str(), win);
+      if (!conf.headless.enabled)
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, conf.game.title.c_str(),
+                                 rtData.rgssErrorMsg.c_str(), win);
     }
 
+    /* Let automated runs tell a script error from a clean exit */
+    int exitCode = (conf.headless.enabled && !rtData.rgssErrorMsg.empty()) ? 1 : 0;
+
     if (rtData.glContext)
       SDL_GL_DeleteContext(rtData.glContext);
 
@@ -501,7 +525,7 @@ int main(int argc, char *argv[]) {
     IMG_Quit();
     SDL_Quit();
 
-    return 0;
+    return exitCode;
 }
 
 static SDL_GLContext initGL(SDL_Window *win, Config &conf,
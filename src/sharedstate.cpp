@@ -30,6 +30,10 @@
 #include "glstate.h"
 #include "shader.h"
 #include "texpool.h"
+#include "spriteatlas.h"
+#include "spritebatch.h"
+#include "programcache.h"
+#include "imagesaver.h"
 #include "font.h"
 #include "eventthread.h"
 #include "gl-util.h"
@@ -70,6 +74,12 @@ struct SharedStatePrivate
 
 	TexPool texPool;
 
+	SpriteAtlas spriteAtlas;
+
+	SpriteBatch spriteBatch;
+
+	ImageSaver imageSaver;
+
 	SharedFontState fontState;
 	Font *defaultFont;
 
@@ -99,15 +109,13 @@ struct SharedStatePrivate
 	      input(*threadData),
 	      audio(*threadData),
 	      _glState(threadData->config),
+	      texPool(threadData->config),
+	      spriteAtlas(threadData->config),
 	      fontState(threadData->config),
 	      stampCounter(0)
 	{
         
         startupTime = std::chrono::steady_clock::now();
-        
-		/* Shaders have been compiled in ShaderSet's constructor */
-		if (gl.ReleaseShaderCompiler)
-			gl.ReleaseShaderCompiler();
 
 		const char* metaPath = config.encryption.metaFile.c_str();
 
@@ -173,13 +181,17 @@ void SharedState::initInstance(RGSSThreadData *threadData)
 {
 	/* This section is tricky because of dependencies:
 	 * SharedState depends on GlobalIBO existing,
-	 * Font depends on SharedState existing */
+	 * Font depends on SharedState existing,
+	 * the shaders built by SharedState depend on
+	 * ProgramCache being initialized */
 
 	rgssVersion = threadData->config.rgssVersion;
     
 	_globalIBO = new GlobalIBO();
 	_globalIBO->ensureSize(1);
 
+	ProgramCache::init(threadData->config);
+
 	SharedState::instance = 0;
 	Font *defaultFont = 0;
 
@@ -235,6 +247,9 @@ GSATT(Audio&, audio)
 GSATT(GLState&, _glState)
 GSATT(ShaderSet&, shaders)
 GSATT(TexPool&, texPool)
+GSATT(SpriteAtlas&, spriteAtlas)
+GSATT(SpriteBatch&, spriteBatch)
+GSATT(ImageSaver&, imageSaver)
 GSATT(Quad&, gpQuad)
 GSATT(SharedFontState&, fontState)
 
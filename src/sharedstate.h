@@ -45,6 +45,9 @@ class Input;
 class Audio;
 class GLState;
 class TexPool;
+class SpriteAtlas;
+class SpriteBatch;
+class ImageSaver;
 class Font;
 class SharedFontState;
 struct GlobalIBO;
@@ -78,6 +81,12 @@ struct SharedState
 
 	TexPool &texPool() const;
 
+	SpriteAtlas &spriteAtlas() const;
+
+	SpriteBatch &spriteBatch() const;
+
+	ImageSaver &imageSaver() const;
+
 	SharedFontState &fontState() const;
 	Font &defaultFont() const;
 
@@ -0,0 +1,333 @@
+/*
+** profiler.cpp
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "profiler.h"
+
+#ifdef MKXPZ_PROFILER
+
+#include "exception.h"
+
+#include <SDL_atomic.h>
+#include <SDL_thread.h>
+#include <SDL_timer.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* Per thread, zones are stored in chunks that are never
+ * moved, so the writer can keep going while they're read */
+#define CHUNK_SIZE 4096
+#define MAX_CHUNKS 256
+
+struct Zone
+{
+	const char *name;
+	uint64_t start, end;
+};
+
+struct ThreadBuffer
+{
+	int tid;
+	char name[64];
+
+	Zone *chunks[MAX_CHUNKS];
+
+	/* Published by the owning thread once a zone is complete */
+	SDL_atomic_t count;
+	SDL_atomic_t session;
+	SDL_atomic_t dropped;
+
+	/* Set when the owning thread exits */
+	SDL_atomic_t retired;
+
+	ThreadBuffer(int tid)
+	    : tid(tid)
+	{
+		name[0] = '\0';
+		memset(chunks, 0, sizeof(chunks));
+
+		SDL_AtomicSet(&count, 0);
+		SDL_AtomicSet(&session, 0);
+		SDL_AtomicSet(&dropped, 0);
+		SDL_AtomicSet(&retired, 0);
+	}
+
+	~ThreadBuffer()
+	{
+		for (int i = 0; i < MAX_CHUNKS; ++i)
+			delete[] chunks[i];
+	}
+};
+
+struct ThreadSlot
+{
+	ThreadBuffer *buffer;
+	const char *name;
+
+	~ThreadSlot()
+	{
+		if (buffer)
+			SDL_AtomicSet(&buffer->retired, 1);
+	}
+};
+
+static thread_local ThreadSlot threadSlot;
+
+static SDL_atomic_t activeFlag;
+static SDL_atomic_t sessionId;
+static uint64_t sessionStart;
+
+/* Only taken when a thread records its first zone,
+ * or a session starts or stops */
+static SDL_SpinLock registryLock;
+static std::vector<ThreadBuffer*> registry;
+static int tidCounter;
+
+static void setBufferName(ThreadBuffer *buffer, const char *name)
+{
+	if (name)
+		snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+	else
+		snprintf(buffer->name, sizeof(buffer->name), "Thread %lu", (unsigned long) SDL_ThreadID());
+}
+
+static ThreadBuffer *threadBuffer()
+{
+	if (threadSlot.buffer)
+		return threadSlot.buffer;
+
+	SDL_AtomicLock(&registryLock);
+
+	ThreadBuffer *buffer = new ThreadBuffer(++tidCounter);
+	setBufferName(buffer, threadSlot.name);
+	registry.push_back(buffer);
+
+	SDL_AtomicUnlock(&registryLock);
+
+	threadSlot.buffer = buffer;
+
+	return buffer;
+}
+
+/* Escapes the few characters that can't appear raw in a JSON string */
+static void writeString(FILE *f, const char *str)
+{
+	fputc('"', f);
+
+	for (; *str; ++str)
+	{
+		if (*str == '"' || *str == '\\')
+			fputc('\\', f);
+
+		if ((unsigned char) *str >= 0x20)
+			fputc(*str, f);
+	}
+
+	fputc('"', f);
+}
+
+bool Profiler::available()
+{
+	return true;
+}
+
+bool Profiler::start()
+{
+	SDL_AtomicLock(&registryLock);
+
+	/* Nobody will write to these again */
+	for (size_t i = 0; i < registry.size();)
+	{
+		if (SDL_AtomicGet(&registry[i]->retired))
+		{
+			delete registry[i];
+			registry.erase(registry.begin() + i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	sessionStart = SDL_GetPerformanceCounter();
+
+	/* Buffers notice the new session on their next
+	 * zone and start over on their own */
+	SDL_AtomicAdd(&sessionId, 1);
+	SDL_AtomicSet(&activeFlag, 1);
+
+	SDL_AtomicUnlock(&registryLock);
+
+	return true;
+}
+
+int Profiler::stop(const char *path)
+{
+	if (!active())
+		return -1;
+
+	/* Keep recording if there's nowhere to put the trace */
+	FILE *f = fopen(path, "w");
+
+	if (!f)
+		throw Exception(Exception::IOError, "Failed to open %s for writing", path);
+
+	SDL_AtomicSet(&activeFlag, 0);
+
+	const double toUs = 1000000.0 / SDL_GetPerformanceFrequency();
+	const int session = SDL_AtomicGet(&sessionId);
+	int written = 0;
+	bool first = true;
+
+	fputs("{\"traceEvents\":[\n", f);
+
+	SDL_AtomicLock(&registryLock);
+
+	for (size_t i = 0; i < registry.size(); ++i)
+	{
+		ThreadBuffer *buffer = registry[i];
+
+		if (SDL_AtomicGet(&buffer->session) != session)
+			continue;
+
+		const int count = SDL_AtomicGet(&buffer->count);
+
+		fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+		        first ? "" : ",\n", buffer->tid);
+		writeString(f, buffer->name);
+		fputs("}}", f);
+		first = false;
+
+		for (int j = 0; j < count; ++j)
+		{
+			const Zone &zone = buffer->chunks[j / CHUNK_SIZE][j % CHUNK_SIZE];
+
+			/* Begun before the session did */
+			if (zone.start < sessionStart)
+				continue;
+
+			fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			        zone.name, buffer->tid,
+			        (zone.start - sessionStart) * toUs,
+			        (zone.end - zone.start) * toUs);
+			++written;
+		}
+
+		const int dropped = SDL_AtomicGet(&buffer->dropped);
+
+		if (dropped > 0)
+			fprintf(f, ",\n{\"ph\":\"C\",\"name\":\"dropped zones\",\"pid\":1,\"tid\":%d,\"ts\":0,\"args\":{\"count\":%d}}",
+			        buffer->tid, dropped);
+	}
+
+	SDL_AtomicUnlock(&registryLock);
+
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+
+	bool ok = !ferror(f);
+	fclose(f);
+
+	if (!ok)
+		throw Exception(Exception::IOError, "Failed to write profile to %s", path);
+
+	return written;
+}
+
+bool Profiler::active()
+{
+	return SDL_AtomicGet(&activeFlag);
+}
+
+void Profiler::nameThread(const char *name)
+{
+	threadSlot.name = name;
+
+	if (!threadSlot.buffer)
+		return;
+
+	SDL_AtomicLock(&registryLock);
+	setBufferName(threadSlot.buffer, name);
+	SDL_AtomicUnlock(&registryLock);
+}
+
+void Profiler::record(const char *name, uint64_t start, uint64_t end)
+{
+	if (!active())
+		return;
+
+	ThreadBuffer *buffer = threadBuffer();
+	const int session = SDL_AtomicGet(&sessionId);
+
+	if (SDL_AtomicGet(&buffer->session) != session)
+	{
+		SDL_AtomicSet(&buffer->count, 0);
+		SDL_AtomicSet(&buffer->dropped, 0);
+		SDL_AtomicSet(&buffer->session, session);
+	}
+
+	const int index = SDL_AtomicGet(&buffer->count);
+	const int chunk = index / CHUNK_SIZE;
+
+	if (chunk >= MAX_CHUNKS)
+	{
+		SDL_AtomicAdd(&buffer->dropped, 1);
+		return;
+	}
+
+	if (!buffer->chunks[chunk])
+		buffer->chunks[chunk] = new Zone[CHUNK_SIZE];
+
+	Zone &zone = buffer->chunks[chunk][index % CHUNK_SIZE];
+	zone.name = name;
+	zone.start = start;
+	zone.end = end;
+
+	SDL_AtomicSet(&buffer->count, index + 1);
+}
+
+#else
+
+bool Profiler::available()
+{
+	return false;
+}
+
+bool Profiler::start()
+{
+	return false;
+}
+
+int Profiler::stop(const char *)
+{
+	return -1;
+}
+
+bool Profiler::active()
+{
+	return false;
+}
+
+void Profiler::nameThread(const char *)
+{}
+
+void Profiler::record(const char *, uint64_t, uint64_t)
+{}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+** profiler.h
+**
+** This file is part of mkxp.
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+/* Records timed zones from any thread and writes them out
+ * in the Chrome trace event format (chrome://tracing, Perfetto).
+ * Every thread appends to a buffer only it writes to, so
+ * recording never takes a lock.
+ *
+ * The zone macros only expand to anything when built with
+ * MKXPZ_PROFILER; otherwise start() refuses to run and the
+ * instrumented code is exactly what it was without them */
+class Profiler
+{
+public:
+	/* Whether the zone macros were compiled in */
+	static bool available();
+
+	/* Drops whatever the previous session recorded.
+	 * Returns false if the profiler isn't available */
+	static bool start();
+
+	/* Stops recording and writes the session to 'path'.
+	 * Returns the number of zones written */
+	static int stop(const char *path);
+
+	static bool active();
+
+	/* Names the calling thread in the trace */
+	static void nameThread(const char *name);
+
+	/* 'name' must outlive the session (use literals) */
+	static void record(const char *name, uint64_t start, uint64_t end);
+};
+
+#ifdef MKXPZ_PROFILER
+
+#include <SDL_timer.h>
+
+struct ProfileZone
+{
+	const char *name;
+	uint64_t start;
+
+	ProfileZone(const char *name)
+	    : name(name),
+	      start(Profiler::active() ? SDL_GetPerformanceCounter() : 0)
+	{}
+
+	~ProfileZone()
+	{
+		if (start)
+			Profiler::record(name, start, SDL_GetPerformanceCounter());
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_ZONE(name) \
+	ProfileZone PROFILE_CONCAT(__profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::nameThread(name)
+#define PROFILE_RECORD(name, start, end) Profiler::record(name, start, end)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_RECORD(name, start, end)
+
+#endif
+
+#endif // PROFILER_H